@@ -0,0 +1,1017 @@
+/**
+ * @file  Bench.cpp
+ * @brief Throughput benchmark of every engine over the roms of a directory or of the bundle
+ * @details
+ * Each rom runs headless for a fixed number of instructions with scripted input, several
+ * times per engine. The mix of executed instructions is counted once per rom with the
+ * interpreter, since every engine executes the same instructions. MIPS only count executed
+ * instructions, the share skipped in idle loops and waits for a key is given apart. Results
+ * are printed as a table and written as JSON so they can be compared between commits.
+ * With --check nothing is timed: every engine runs each rom at several instructions per frame,
+ * with both tables of handlers, and must end in the state and cycle count of the interpreter.
+ * The probes of bench/probes are run the same way, each one must end with VE set to 1. Then a
+ * save state of each rom must restore to the same hash and run on the same way, damaged ones
+ * must be refused. Then a movie of each rom is recorded, read back and replayed, damaged movies
+ * must be refused. Last lanes of each rom must end every lane like a machine running alone
+ */
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/CHIP-8/CHIP_8.hpp"
+#include "../src/CHIP-8/Bundle.hpp"
+#include "../src/CHIP-8/Disassembler.hpp"
+#include "../src/CHIP-8/Lanes.hpp"
+#include "../src/CHIP-8/Movie.hpp"
+#include "../src/Headless/Headless.hpp"
+
+static constexpr const Engine engines[] = { ENGINE_INTERPRETER, ENGINE_THREADED, ENGINE_STATIC };
+
+#define NUMBER_ENGINE (sizeof(engines) / sizeof(engines[0]))
+
+/*
+ * Instructions per frame of --check, single steps, odd frames ending inside blocks and long frames
+ */
+static constexpr const unsigned long check_frames[] = { 1, 7, CYCLES_PER_FRAME, 100, 997 };
+
+/*
+ * Settings of the command line
+ */
+struct Settings
+{
+	std::string   roms;      /* Directory of the roms */
+	std::string   probes;    /* Directory of the probes run by --check */
+	bool          bundle;    /* Roms compiled into the binary instead of roms */
+	std::string   json;      /* File receiving the results */
+	unsigned long cycles;    /* Instructions executed by each run */
+	unsigned      repeat;    /* Runs of each rom with each engine */
+	unsigned long cycles_per_frame;
+	u32           seed;      /* Seed of the random generator of every run */
+	bool          specialised;  /* See CHIP_8::specialised */
+	bool          check;     /* Compare engines instead of timing them */
+	bool          engine[NUMBER_ENGINE];
+};
+
+/*
+ * Measures of a rom with one engine
+ */
+struct Measure
+{
+	std::vector<double> mips;  /* Millions of executed instructions per second of each run */
+	unsigned long executed;    /* Instructions executed by the last run */
+	unsigned long skipped;     /* Instructions of the last run counted without being executed */
+	bool          fault;       /* The rom stopped on an invalid instruction */
+};
+
+/*
+ * Results of a rom
+ */
+struct Result
+{
+	std::string   name;
+	unsigned long count[NUMBER_CLASS];
+	Measure       measure[NUMBER_ENGINE];
+};
+
+/**
+ * @brief Press keys like a player would, the same way on every run
+ * @details Every half second a key of a fixed sequence is held for a quarter of second
+ */
+static void Script_Input(CPU &cpu, unsigned long frame)
+{
+	static constexpr const u8 sequence[] =
+	{
+		0x4, 0x6, 0x1, 0x4, 0x5, 0x6, 0xC, 0xD, 0x7, 0x8, 0x2, 0xA, 0x0, 0xF, 0x3, 0xB, 0x9, 0xE
+	};
+
+	memset(cpu.key, 0, sizeof(cpu.key));
+	if (frame % 30 < 15){
+		cpu.key[sequence[(frame / 30) % sizeof(sequence)]] = 1;
+	}
+}
+
+/**
+ * @brief Prepare a machine for a run, the random generator is seeded so runs are identical
+ */
+static void Prepare(CHIP_8 &chip8, const Rom &rom, const Settings &settings, Engine engine)
+{
+	chip8.engine           = engine;
+	chip8.cycles_per_frame = settings.cycles_per_frame;
+	chip8.specialised      = settings.specialised;
+	chip8.load(rom);
+	chip8.cpu.seed(settings.seed);
+}
+
+/**
+ * @brief Count executed instructions of each class, one at a time with the interpreter
+ */
+static void Count_Classes(const Rom &rom, const Settings &settings, unsigned long *count)
+{
+	CHIP_8 chip8;
+
+	Prepare(chip8, rom, settings, ENGINE_INTERPRETER);
+
+	for(unsigned long done = 0; done < settings.cycles && !chip8.cpu.fault; ++done)
+	{
+		if (done % chip8.cycles_per_frame == 0){
+			Script_Input(chip8.cpu, done / chip8.cycles_per_frame);
+		}
+
+		u16 pc     = chip8.cpu.pc & (MEMORY_SIZE - 1);
+		u16 opcode = chip8.cpu.memory[pc] << 8 | chip8.cpu.memory[(pc + 1) & (MEMORY_SIZE - 1)];
+
+		++count[Classify_Opcode(opcode)];
+		chip8.run(1);
+
+		if ((done + 1) % chip8.cycles_per_frame == 0){
+			chip8.tick_timers();
+		}
+	}
+}
+
+/**
+ * @brief Run a prepared machine frame after frame with scripted input
+ * @details Whole frames go through CHIP_8::run_frame like in the window, the last one may be shorter
+ * @return number of instructions executed or skipped
+ */
+static unsigned long Run_Scripted(CHIP_8 &chip8, unsigned long cycles)
+{
+	unsigned long done = 0;
+
+	for(unsigned long frame = 0; done < cycles && !chip8.cpu.fault; ++frame)
+	{
+		Script_Input(chip8.cpu, frame);
+		if (cycles - done >= chip8.cycles_per_frame){
+			done += chip8.run_frame();
+		}
+		else
+		{
+			done += chip8.run(cycles - done);
+			chip8.tick_timers();
+		}
+	}
+	return done;
+}
+
+/**
+ * @brief Time one run of a rom, frame after frame
+ * @return millions of executed instructions per second, skipped ones are not counted
+ */
+static double Time_Run(const Rom &rom, const Settings &settings, Engine engine, Measure &measure)
+{
+	CHIP_8 chip8;
+
+	Prepare(chip8, rom, settings, engine);
+
+	auto start = std::chrono::steady_clock::now();
+
+	unsigned long done = Run_Scripted(chip8, settings.cycles);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	measure.executed = done - chip8.skipped;
+	measure.skipped  = chip8.skipped;
+	measure.fault    = chip8.cpu.fault;
+	return seconds > 0 ? measure.executed / seconds / 1e6 : 0;
+}
+
+/**
+ * @brief Mean and standard deviation of the runs
+ */
+static void Statistics(const std::vector<double> &values, double &mean, double &deviation)
+{
+	mean      = 0;
+	deviation = 0;
+	if (values.empty())
+		return;
+
+	for(double value : values){
+		mean += value;
+	}
+	mean /= values.size();
+
+	if (values.size() < 2)
+		return;
+
+	for(double value : values){
+		deviation += (value - mean) * (value - mean);
+	}
+	deviation = std::sqrt(deviation / (values.size() - 1));
+}
+
+/**
+ * @brief Print a table of the results
+ */
+static void Print_Table(const std::vector<Result> &results, const Settings &settings)
+{
+	printf("\n%-10s %-12s %10s %10s %10s %8s %8s\n", "rom", "engine", "MIPS", "ns/instr", "stddev", "cv %", "skip %");
+
+	for(const Result &result : results)
+	{
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			const Measure &measure = result.measure[e];
+			const unsigned long counted = measure.executed + measure.skipped;
+			double mean, deviation;
+
+			Statistics(measure.mips, mean, deviation);
+			printf("%-10s %-12s %10.2f %10.2f %10.2f %8.2f %8.2f%s\n",
+			       result.name.c_str(), Engine_Name(engines[e]), mean, mean > 0 ? 1e3 / mean : 0.0,
+			       deviation, mean > 0 ? 100 * deviation / mean : 0.0,
+			       counted ? 100.0 * measure.skipped / counted : 0.0, measure.fault ? " fault" : "");
+		}
+	}
+}
+
+/**
+ * @brief Write the results as JSON
+ * @return false when the file can not be written
+ */
+static bool Write_JSON(const std::vector<Result> &results, const Settings &settings)
+{
+	FILE *file = fopen(settings.json.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "{\n  \"cycles\": %lu,\n  \"repeat\": %u,\n  \"cycles_per_frame\": %lu,\n  \"seed\": %u,\n  \"handlers\": \"%s\",\n  \"roms\": [",
+	        settings.cycles, settings.repeat, settings.cycles_per_frame, settings.seed,
+	        settings.specialised ? "specialised" : "decoded");
+
+	for(size_t r = 0; r < results.size(); ++r)
+	{
+		const Result &result = results[r];
+		unsigned long total  = 0;
+
+		for(unsigned c = 0; c < NUMBER_CLASS; ++c){
+			total += result.count[c];
+		}
+
+		fprintf(file, "%s\n    {\n      \"name\": \"%s\",\n      \"classes\": {", r ? "," : "", result.name.c_str());
+		for(unsigned c = 0; c < NUMBER_CLASS; ++c)
+		{
+			fprintf(file, "%s\n        \"%s\": { \"count\": %lu, \"share\": %.6f }", c ? "," : "",
+			        Class_Name((Opcode_Class)c), result.count[c], total ? (double)result.count[c] / total : 0.0);
+		}
+		fprintf(file, "\n      },\n      \"engines\": {");
+
+		bool first = true;
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			const Measure &measure = result.measure[e];
+			double mean, deviation;
+
+			Statistics(measure.mips, mean, deviation);
+			fprintf(file, "%s\n        \"%s\": {\n", first ? "" : ",", Engine_Name(engines[e]));
+			fprintf(file, "          \"executed\": %lu,\n          \"skipped\": %lu,\n          \"fault\": %s,\n",
+			        measure.executed, measure.skipped, measure.fault ? "true" : "false");
+			fprintf(file, "          \"mips\": %.4f,\n          \"ns_per_instruction\": %.4f,\n",
+			        mean, mean > 0 ? 1e3 / mean : 0.0);
+			fprintf(file, "          \"stddev_mips\": %.4f,\n          \"variance_mips\": %.4f,\n",
+			        deviation, deviation * deviation);
+			fprintf(file, "          \"min_mips\": %.4f,\n          \"max_mips\": %.4f,\n          \"runs\": [",
+			        *std::min_element(measure.mips.begin(), measure.mips.end()),
+			        *std::max_element(measure.mips.begin(), measure.mips.end()));
+			for(size_t i = 0; i < measure.mips.size(); ++i){
+				fprintf(file, "%s%.4f", i ? ", " : "", measure.mips[i]);
+			}
+			fprintf(file, "]\n        }");
+			first = false;
+		}
+		fprintf(file, "\n      }\n    }");
+	}
+	fprintf(file, "\n  ]\n}\n");
+	return fclose(file) == 0;
+}
+
+/**
+ * @brief Run a rom with an engine, a table of handlers and a number of instructions per frame
+ * @param executed receives the number of instructions executed
+ * @return State_Hash of the machine at the end
+ */
+static u64 Check_Run(const Rom &rom, const Settings &settings, Engine engine, bool specialised,
+                     unsigned long cycles_per_frame, unsigned long &executed)
+{
+	CHIP_8 chip8;
+	Settings variant = settings;
+
+	variant.specialised      = specialised;
+	variant.cycles_per_frame = cycles_per_frame;
+	Prepare(chip8, rom, variant, engine);
+
+	executed = Run_Scripted(chip8, settings.cycles);
+	return State_Hash(chip8);
+}
+
+/**
+ * @brief Compare every chosen engine with the interpreter on each rom, print the ones which differ
+ * @return exit code of the program, 3 when an engine differs
+ */
+static int Check_Engines(const std::vector<std::string> &names, const std::vector<const Rom*> &roms, const Settings &settings)
+{
+	static constexpr const bool tables[] = { true, false };
+
+	unsigned runs       = 0;
+	unsigned mismatches = 0;
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		for(unsigned long cycles_per_frame : check_frames)
+		{
+			unsigned long expected_cycles;
+			const u64 expected = Check_Run(*roms[r], settings, ENGINE_INTERPRETER, true, cycles_per_frame, expected_cycles);
+
+			for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+			{
+				if (!settings.engine[e])
+					continue;
+
+				for(bool specialised : tables)
+				{
+					// The reference itself
+					if (engines[e] == ENGINE_INTERPRETER && specialised)
+						continue;
+
+					unsigned long executed;
+					const u64 hash = Check_Run(*roms[r], settings, engines[e], specialised, cycles_per_frame, executed);
+
+					++runs;
+					if (hash == expected && executed == expected_cycles)
+						continue;
+
+					++mismatches;
+					printf("%-10s %-12s %-12s %4lu cycles/frame: %.16llX after %lu cycles, interpreter %.16llX after %lu\n",
+					       names[r].c_str(), Engine_Name(engines[e]), specialised ? "specialised" : "decoded", cycles_per_frame,
+					       (unsigned long long)hash, executed, (unsigned long long)expected, expected_cycles);
+				}
+			}
+		}
+	}
+
+	printf("Checked %u runs of %zu roms, %u differ from the interpreter\n", runs, roms.size(), mismatches);
+	return mismatches ? 3 : 0;
+}
+
+/**
+ * @brief Run the probes on every chosen engine, print the ones which do not pass
+ * @details
+ * A probe is a rom testing instructions on itself, it ends in a loop with VE set to 1 when every
+ * test passed and in another one with VE set to 0 otherwise. ALIASES runs the opcodes decoded
+ * on part of their bits, 0nn0 and 0nnE as 00E0 and 00EE, 5xyn and 9xyn as 5xy0 and 9xy0.
+ * Probes are recompiled with the roms, so the static engine runs them compiled
+ * @return exit code of the program, 3 when a probe fails
+ */
+static int Check_Probes(const std::vector<std::string> &names, const std::vector<const Rom*> &probes, const Settings &settings)
+{
+	static constexpr const bool tables[] = { true, false };
+
+	unsigned runs     = 0;
+	unsigned failures = 0;
+
+	for(size_t p = 0; p < probes.size(); ++p)
+	{
+		for(unsigned long cycles_per_frame : check_frames)
+		{
+			for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+			{
+				if (!settings.engine[e])
+					continue;
+
+				for(bool specialised : tables)
+				{
+					CHIP_8 chip8;
+					Settings variant = settings;
+
+					variant.specialised      = specialised;
+					variant.cycles_per_frame = cycles_per_frame;
+					Prepare(chip8, *probes[p], variant, engines[e]);
+					Run_Scripted(chip8, settings.cycles);
+
+					++runs;
+					if (!chip8.cpu.fault && chip8.cpu.V[0xE] == 1)
+						continue;
+
+					++failures;
+					printf("%-10s %-12s %-12s %4lu cycles/frame: %s at 0x%.3X\n",
+					       names[p].c_str(), Engine_Name(engines[e]), specialised ? "specialised" : "decoded", cycles_per_frame,
+					       chip8.cpu.fault ? "faulted" : "failed", chip8.cpu.pc);
+				}
+			}
+		}
+	}
+
+	printf("Checked %u runs of %zu probes, %u fail\n", runs, probes.size(), failures);
+	return failures ? 3 : 0;
+}
+
+/**
+ * @brief Run frames of a machine with the scripted input of a run which started at frame 0
+ */
+static void Run_Frames(CHIP_8 &chip8, unsigned long first, unsigned long count)
+{
+	for(unsigned long frame = first; frame < first + count; ++frame)
+	{
+		Script_Input(chip8.cpu, frame);
+		chip8.run_frame();
+	}
+}
+
+/**
+ * @brief Save and restore a state of each rom on every chosen engine, print the ones which fail
+ * @details
+ * A state saved halfway through the run is restored into the machine which ran on and into a
+ * fresh one, both must have the hash of the saved machine then end like the machine which never
+ * restored. Every shorter copy of the state, a state of another version and one with a stack
+ * pointer past the stack must be refused without touching the machine
+ * @return exit code of the program, 3 when a state fails
+ */
+static int Check_States(const std::vector<std::string> &names, const std::vector<const Rom*> &roms, const Settings &settings)
+{
+	// Offsets in a state, see State.cpp
+	static constexpr const unsigned version_at = 4;
+	static constexpr const unsigned sp_at      = 38;
+
+	unsigned runs     = 0;
+	unsigned failures = 0;
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			CHIP_8 chip8;
+			Prepare(chip8, *roms[r], settings, engines[e]);
+
+			const unsigned long frames = std::max(settings.cycles / settings.cycles_per_frame / 2, 1ul);
+			Run_Frames(chip8, 0, frames);
+
+			u8 state[STATE_MAX_SIZE];
+			const unsigned long size = chip8.save(state, sizeof(state));
+			const u64 saved = State_Hash(chip8);
+
+			Run_Frames(chip8, frames, frames);
+			const u64 ended = State_Hash(chip8);
+
+			const char *failure = nullptr;
+			std::vector<u8> bad;
+
+			for(unsigned long cut = 0; cut < size && !failure; ++cut)
+			{
+				if (chip8.restore(state, cut)){
+					failure = "a truncated state was restored";
+				}
+			}
+
+			bad.assign(state, state + size);
+			bad[version_at] = STATE_VERSION + 1;
+			if (!failure && chip8.restore(bad.data(), size)){
+				failure = "a state of another version was restored";
+			}
+
+			bad.assign(state, state + size);
+			bad[sp_at] = NUMBER_REGISTER + 1;
+			if (!failure && chip8.restore(bad.data(), size)){
+				failure = "a stack pointer past the stack was restored";
+			}
+
+			if (!failure && State_Hash(chip8) != ended){
+				failure = "a refused state changed the machine";
+			}
+
+			if (!failure && (size == 0 || !chip8.restore(state, size) || State_Hash(chip8) != saved)){
+				failure = "the state was not restored";
+			}
+
+			Run_Frames(chip8, frames, frames);
+			if (!failure && State_Hash(chip8) != ended){
+				failure = "the run differs after the restore";
+			}
+
+			CHIP_8 fresh;
+			Prepare(fresh, *roms[r], settings, engines[e]);
+			if (!failure && (!fresh.restore(state, size) || State_Hash(fresh) != saved)){
+				failure = "the state was not restored by a fresh machine";
+			}
+
+			Run_Frames(fresh, frames, frames);
+			if (!failure && State_Hash(fresh) != ended){
+				failure = "the run of a fresh machine differs after the restore";
+			}
+
+			++runs;
+			if (!failure)
+				continue;
+
+			++failures;
+			printf("%-10s %-12s state of %lu bytes: %s\n", names[r].c_str(), Engine_Name(engines[e]), size, failure);
+		}
+	}
+
+	printf("Checked %u states of %zu roms, %u fail\n", runs, roms.size(), failures);
+	return failures ? 3 : 0;
+}
+
+/**
+ * @brief Replace a file with bytes
+ * @return false when the file can not be written
+ */
+static bool Write_Bytes(const std::string &path, const std::vector<u8> &bytes)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return fclose(file) == 0 && written;
+}
+
+/**
+ * @brief Read every byte of a file
+ * @return false when the file can not be read
+ */
+static bool Read_Bytes(const std::string &path, std::vector<u8> &bytes)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	u8 chunk[1 << 12];
+	bytes.clear();
+	for(size_t got; (got = fread(chunk, 1, sizeof(chunk), file)) > 0; ){
+		bytes.insert(bytes.end(), chunk, chunk + got);
+	}
+	fclose(file);
+	return true;
+}
+
+/**
+ * @brief Whether a damaged movie is refused, by read or by seek to its second keyframe
+ */
+static bool Refused(const std::string &path, const std::vector<u8> &bytes, const Rom &rom, const Settings &settings, Engine engine)
+{
+	Movie movie;
+	CHIP_8 chip8;
+
+	Prepare(chip8, rom, settings, engine);
+	return Write_Bytes(path, bytes) && (!movie.read(path.c_str()) || !movie.seek(chip8, MOVIE_KEYFRAME));
+}
+
+/**
+ * @brief Record a movie of each rom on every chosen engine and replay it, print the ones which fail
+ * @details
+ * The movie is written then read back, seeking to frames around its keyframes and playing it
+ * from the start must give the hashes seen while recording. A movie of another version, a
+ * truncated one, keyframes which do not start at frame 0 or point past the events, and a
+ * keyframe with a stack pointer past the stack must be refused
+ * @return exit code of the program, 3 when a movie fails
+ */
+static int Check_Movies(const std::vector<std::string> &names, const std::vector<const Rom*> &roms, const Settings &settings)
+{
+	// Offsets in a movie, see Movie.cpp, and of the stack pointer in a state, see State.cpp
+	static constexpr const unsigned version_at = 4;
+	static constexpr const unsigned events_at  = 29;
+	static constexpr const unsigned sp_at      = 38;
+
+	static constexpr const u64 length    = 2 * MOVIE_KEYFRAME + 300;
+	static constexpr const u64 targets[] = { 0, 1, MOVIE_KEYFRAME - 1, MOVIE_KEYFRAME, MOVIE_KEYFRAME + 1, length };
+
+	std::error_code error;
+	const std::string path = (std::filesystem::temp_directory_path(error) / "bench_check.c8mv").string();
+
+	// Refused movies are expected, their messages are not
+	std::streambuf *messages = std::cerr.rdbuf();
+
+	unsigned runs     = 0;
+	unsigned failures = 0;
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			CHIP_8 chip8;
+			Prepare(chip8, *roms[r], settings, engines[e]);
+
+			Movie recording;
+			std::vector<u64> hashes;
+
+			recording.start(chip8, settings.seed);
+			for(u64 frame = 0; frame < length; ++frame)
+			{
+				hashes.push_back(State_Hash(chip8));
+				Script_Input(chip8.cpu, frame);
+				recording.record(chip8);
+				chip8.run_frame();
+			}
+			hashes.push_back(State_Hash(chip8));
+
+			const char *failure = nullptr;
+			std::vector<u8> bytes;
+			Movie movie;
+
+			if (!recording.write(path.c_str()) || !Read_Bytes(path, bytes) || !movie.read(path.c_str()) || movie.length != length){
+				failure = "the movie was not read back";
+			}
+
+			for(u64 target : targets)
+			{
+				CHIP_8 replay;
+				Prepare(replay, *roms[r], settings, engines[e]);
+				if (!failure && (!movie.seek(replay, target) || State_Hash(replay) != hashes[target])){
+					failure = "a seek differs from the recording";
+				}
+			}
+
+			CHIP_8 replay;
+			Prepare(replay, *roms[r], settings, engines[e]);
+			if (!failure && movie.seek(replay, 0))
+			{
+				while (movie.play(replay)){
+					replay.run_frame();
+				}
+				if (State_Hash(replay) != hashes[length]){
+					failure = "the replay differs from the recording";
+				}
+			}
+
+			if (!failure)
+			{
+				const unsigned long events   = movie.events.size();
+				const unsigned long first    = events_at + events + 4;
+				const unsigned long second   = first + 24 + movie.keyframes[0].state_size;
+				std::vector<u8> bad;
+
+				std::cerr.rdbuf(nullptr);
+
+				bad = bytes;
+				bad[version_at] = MOVIE_VERSION + 1;
+				if (!Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a movie of another version was read";
+				}
+
+				bad.assign(bytes.begin(), bytes.end() - 1);
+				if (!failure && !Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a truncated movie was read";
+				}
+
+				bad.assign(bytes.begin(), bytes.begin() + events_at + events / 2);
+				if (!failure && !Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a movie truncated in its events was read";
+				}
+
+				bad = bytes;
+				bad[first] = 1;
+				if (!failure && !Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a first keyframe past frame 0 was read";
+				}
+
+				bad = bytes;
+				memset(bad.data() + second + 16, 0xFF, 4);
+				if (!failure && !Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a keyframe past the events was read";
+				}
+
+				bad = bytes;
+				bad[second + 24 + sp_at] = NUMBER_REGISTER + 1;
+				if (!failure && !Refused(path, bad, *roms[r], settings, engines[e])){
+					failure = "a keyframe with a stack pointer past the stack was restored";
+				}
+
+				std::cerr.rdbuf(messages);
+			}
+
+			++runs;
+			if (!failure)
+				continue;
+
+			++failures;
+			printf("%-10s %-12s movie of %zu bytes: %s\n", names[r].c_str(), Engine_Name(engines[e]), bytes.size(), failure);
+		}
+	}
+
+	std::filesystem::remove(path, error);
+
+	printf("Checked %u movies of %zu roms, %u fail\n", runs, roms.size(), failures);
+	return failures ? 3 : 0;
+}
+
+/**
+ * @brief Run lanes of each rom on every chosen engine, print the lanes which differ from a machine alone
+ * @details
+ * Lanes sharing a seed press keys at other times, lanes pressing the same keys have other seeds,
+ * so lanes converge and part. Each lane must end with the hash, fault, frames and instructions
+ * of a machine with its seed and keys running alone
+ * @return exit code of the program, 3 when a lane differs
+ */
+static int Check_Lanes(const std::vector<std::string> &names, const std::vector<const Rom*> &roms, const Settings &settings)
+{
+	unsigned runs     = 0;
+	unsigned failures = 0;
+
+	const unsigned long frames = std::max(settings.cycles / settings.cycles_per_frame / 2, 1ul);
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			Lanes *lanes = new Lanes();
+			lanes->cycles_per_frame = settings.cycles_per_frame;
+			for(unsigned n = 0; n < LANES; ++n){
+				lanes->machine[n].specialised = settings.specialised;
+			}
+			lanes->load(*roms[r], LANES);
+			for(unsigned n = 0; n < LANES; ++n)
+			{
+				lanes->machine[n].engine = engines[e];
+				lanes->machine[n].cpu.seed(settings.seed + n / 4);
+			}
+
+			for(unsigned long frame = 0; frame < frames && lanes->active; ++frame)
+			{
+				for(unsigned n = 0; n < LANES; ++n){
+					Script_Input(lanes->machine[n].cpu, frame + n % 4 * 15);
+				}
+				lanes->run_frame();
+			}
+
+			for(unsigned n = 0; n < LANES; ++n)
+			{
+				CHIP_8 chip8;
+				Prepare(chip8, *roms[r], settings, engines[e]);
+				chip8.cpu.seed(settings.seed + n / 4);
+
+				unsigned long frame  = 0;
+				unsigned long cycles = 0;
+				for(; frame < frames && !chip8.cpu.fault; ++frame)
+				{
+					Script_Input(chip8.cpu, frame + n % 4 * 15);
+					cycles += chip8.run_frame();
+				}
+
+				const CHIP_8 &lane = lanes->lane(n);
+
+				++runs;
+				if (State_Hash(lane) == State_Hash(chip8) && lane.cpu.fault == chip8.cpu.fault &&
+				    lanes->frames[n] == frame && lanes->cycles[n] == cycles)
+					continue;
+
+				++failures;
+				printf("%-10s %-12s lane %2u: %lu frames %lu cycles, alone %lu frames %lu cycles\n", names[r].c_str(),
+				       Engine_Name(engines[e]), n, lanes->frames[n], lanes->cycles[n], frame, cycles);
+			}
+			delete lanes;
+		}
+	}
+
+	printf("Checked %u lanes of %zu roms, %u differ\n", runs, roms.size(), failures);
+	return failures ? 3 : 0;
+}
+
+/**
+ * @brief Read the roms of a directory, sorted by name so results keep the same order
+ */
+static void Read_Directory(const std::string &directory, std::vector<std::string> &names, std::vector<const Rom*> &roms)
+{
+	std::vector<std::filesystem::path> paths;
+	std::error_code error;
+
+	for(const auto &entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (entry.is_regular_file()){
+			paths.push_back(entry.path());
+		}
+	}
+	std::sort(paths.begin(), paths.end());
+
+	for(const auto &path : paths)
+	{
+		const Rom *rom = Rom_Load(path.string().c_str());
+		if (rom)
+		{
+			names.push_back(path.filename().string());
+			roms.push_back(rom);
+		}
+	}
+}
+
+/**
+ * @brief Read a count given on the command line
+ * @return false when the text is not a number or is zero
+ */
+static bool Parse_Count(const char *text, unsigned long &count)
+{
+	char *end;
+
+	count = strtoul(text, &end, 10);
+	return *text != '\0' && *text != '-' && *end == '\0' && count > 0;
+}
+
+/**
+ * @brief Read a seed given on the command line, 0 included
+ * @return false when the text is not a number of 32 bits
+ */
+static bool Parse_Seed(const char *text, u32 &seed)
+{
+	char *end;
+	unsigned long long value = strtoull(text, &end, 10);
+
+	seed = (u32)value;
+	return *text != '\0' && *text != '-' && *end == '\0' && value <= 0xFFFFFFFFull;
+}
+
+/**
+ * @brief Print command usage
+ */
+static int Usage(void)
+{
+	printf("Usage: bench [--roms DIR|--bundle] [--check] [--probes DIR] [--cycles N] [--repeat N] [--cycles-per-frame N] [--seed N] [--handlers specialised|decoded] [--engine interpreter|threaded|static]... [--json FILE]\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	Settings settings;
+
+	settings.roms   = "roms";
+	settings.probes = "bench/probes";
+	settings.bundle = false;
+	settings.json   = "bench.json";
+	settings.cycles = 5000000;
+	settings.repeat = 5;
+	settings.cycles_per_frame = CYCLES_PER_FRAME;
+	settings.seed             = DEFAULT_SEED;
+	settings.specialised      = true;
+	settings.check            = false;
+
+	bool chosen = false;
+
+	for(unsigned e = 0; e < NUMBER_ENGINE; ++e){
+		settings.engine[e] = true;
+	}
+
+	// Command line
+	for(int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--bundle") == 0)
+		{
+			settings.bundle = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--check") == 0)
+		{
+			settings.check = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+			return Usage();
+
+		if (strcmp(argv[i], "--roms") == 0)
+			settings.roms = argv[++i];
+		else if (strcmp(argv[i], "--probes") == 0)
+			settings.probes = argv[++i];
+		else if (strcmp(argv[i], "--json") == 0)
+			settings.json = argv[++i];
+		else if (strcmp(argv[i], "--cycles") == 0)
+		{
+			if (!Parse_Count(argv[++i], settings.cycles))
+				return Usage();
+		}
+		else if (strcmp(argv[i], "--repeat") == 0)
+		{
+			unsigned long repeat;
+
+			if (!Parse_Count(argv[++i], repeat) || repeat > UINT_MAX)
+				return Usage();
+			settings.repeat = repeat;
+		}
+		else if (strcmp(argv[i], "--cycles-per-frame") == 0)
+		{
+			if (!Parse_Count(argv[++i], settings.cycles_per_frame))
+				return Usage();
+		}
+		else if (strcmp(argv[i], "--seed") == 0)
+		{
+			if (!Parse_Seed(argv[++i], settings.seed))
+				return Usage();
+		}
+		else if (strcmp(argv[i], "--handlers") == 0)
+		{
+			++i;
+			if (strcmp(argv[i], "specialised") == 0)
+				settings.specialised = true;
+			else if (strcmp(argv[i], "decoded") == 0)
+				settings.specialised = false;
+			else
+				return Usage();
+		}
+		else if (strcmp(argv[i], "--engine") == 0)
+		{
+			Engine engine;
+
+			if (!Engine_From_Name(argv[++i], engine))
+				return Usage();
+
+			// The first engine given replaces the default of all engines
+			for(unsigned e = 0; e < NUMBER_ENGINE; ++e){
+				settings.engine[e] = (chosen && settings.engine[e]) || engines[e] == engine;
+			}
+			chosen = true;
+		}
+		else
+			return Usage();
+	}
+	// Roms sorted by name so results keep the same order, read before any run is timed
+	std::vector<std::string> names;
+	std::vector<const Rom*>  roms;
+
+	if (settings.bundle)
+	{
+		for(unsigned i = 0; i < Bundle_Count(); ++i)
+		{
+			names.push_back(Bundle_Get(i).name);
+			roms.push_back(Rom_Bundled(Bundle_Get(i).name));
+		}
+	}
+	else{
+		Read_Directory(settings.roms, names, roms);
+	}
+	if (roms.empty())
+	{
+		fprintf(stderr, "No rom found in %s\n", settings.bundle ? "the bundle" : settings.roms.c_str());
+		return 2;
+	}
+
+	if (settings.check)
+	{
+		std::vector<std::string> probe_names;
+		std::vector<const Rom*>  probes;
+
+		Read_Directory(settings.probes, probe_names, probes);
+		if (probes.empty())
+		{
+			fprintf(stderr, "No probe found in %s\n", settings.probes.c_str());
+			return 2;
+		}
+
+		const int engines_status = Check_Engines(names, roms, settings);
+		const int probes_status  = Check_Probes(probe_names, probes, settings);
+		const int states_status  = Check_States(names, roms, settings);
+		const int movies_status  = Check_Movies(names, roms, settings);
+		const int lanes_status   = Check_Lanes(names, roms, settings);
+
+		return engines_status ? engines_status : probes_status ? probes_status : states_status ? states_status :
+		       movies_status ? movies_status : lanes_status;
+	}
+
+	std::vector<Result> results;
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		Result result;
+
+		result.name = names[r];
+		memset(result.count, 0, sizeof(result.count));
+
+		Count_Classes(*roms[r], settings, result.count);
+
+		for(unsigned e = 0; e < NUMBER_ENGINE; ++e)
+		{
+			if (!settings.engine[e])
+				continue;
+
+			for(unsigned run = 0; run < settings.repeat; ++run){
+				result.measure[e].mips.push_back(Time_Run(*roms[r], settings, engines[e], result.measure[e]));
+			}
+		}
+		results.push_back(result);
+	}
+
+	Print_Table(results, settings);
+
+	if (!Write_JSON(results, settings))
+	{
+		fprintf(stderr, "Failed to write %s\n", settings.json.c_str());
+		return 2;
+	}
+	printf("\nResults written to %s\n", settings.json.c_str());
+	return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file  Bundle.cpp
+ * @brief Roms compiled into the emulator, chosen by name
+ * @details Bundle_Data.hpp is generated from roms/ by tools/Bundle.cpp, see the Makefile
+ */
+#include <cctype>
+#include "Bundle.hpp"
+#include "Bundle_Data.hpp"
+
+/**
+ * @brief Number of roms in the bundle
+ */
+unsigned Bundle_Count(void)
+{
+	return sizeof(bundled_roms) / sizeof(bundled_roms[0]) - 1;
+}
+
+/**
+ * @brief Rom of the bundle at an index below Bundle_Count
+ */
+const Bundled_Rom &Bundle_Get(unsigned index)
+{
+	return bundled_roms[index];
+}
+
+/**
+ * @brief Rom of the bundle with a name, case is ignored
+ * @return nullptr when no rom has that name
+ */
+const Bundled_Rom *Bundle_Find(const char *name)
+{
+	for(const Bundled_Rom *rom = bundled_roms; rom->name; ++rom)
+	{
+		unsigned i = 0;
+		while (name[i] && toupper((unsigned char)name[i]) == toupper((unsigned char)rom->name[i])){
+			++i;
+		}
+		if (name[i] == '\0' && rom->name[i] == '\0')
+			return rom;
+	}
+	return nullptr;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file Bundle.hpp
+ * @brief Roms compiled into the emulator, chosen by name
+ * @see Bundle.cpp
+ */
+#ifndef BUNDLE_HPP
+#define BUNDLE_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Rom of the bundle, generated by tools/Bundle.cpp
+ */
+struct Bundled_Rom
+{
+	const char   *name;  /* File name in roms/ */
+	unsigned long size;  /* Bytes of the rom */
+	u64           hash;  /* FNV-1a hash of data */
+	const u8     *data;
+};
+
+/**
+ * @brief Number of roms in the bundle
+ * @see   Bundle.cpp
+ */
+unsigned Bundle_Count(void);
+
+/**
+ * @brief Rom of the bundle at an index below Bundle_Count
+ * @see   Bundle.cpp
+ */
+const Bundled_Rom &Bundle_Get(unsigned index);
+
+/**
+ * @brief Rom of the bundle with a name, case is ignored
+ * @see   Bundle.cpp
+ * @return nullptr when no rom has that name
+ */
+const Bundled_Rom *Bundle_Find(const char *name);
+
+#endif
@@ -1,278 +1,520 @@
 #include "CHIP_8.hpp"
+#include "Hash.hpp"
+#include "Static/Static.hpp"
+#include "Trace.hpp"
+
+#include <cstring>
 
 /*
- * Using manipulation of file fopen(), fread() etc.
+ * Names of engines indexed by Engine
+ */
+static constexpr const char *engine_names[] = { "interpreter", "threaded", "static" };
+
+/**
+ * @brief Name of an engine, as given on the command line
+ */
+const char *Engine_Name(Engine engine)
+{
+	return engine_names[engine];
+}
+
+/**
+ * @brief Engine of a name given on the command line
+ * @return false when the name is unknown
  */
-#include <cstdio>
+bool Engine_From_Name(const char *name, Engine &engine)
+{
+	for(unsigned i = 0; i < sizeof(engine_names) / sizeof(engine_names[0]); ++i)
+	{
+		if (strcmp(name, engine_names[i]) == 0)
+		{
+			engine = (Engine)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Machine is interpreted until another engine is chosen
+ */
+CHIP_8::CHIP_8(void)
+{
+	engine     = ENGINE_INTERPRETER;
+	recompiled = nullptr;
+	trace      = nullptr;
+
+	cycles_per_frame = CYCLES_PER_FRAME;
+	specialised      = true;
+	idle             = false;
+	fixed_point      = false;
+	settled          = false;
+	settled_keys     = 0;
+	settled_cycles   = 0;
+	skipped          = 0;
+
+	// Without rom, states are saved against the fontset alone
+	memcpy(image, cpu.memory, MEMORY_SIZE);
+	image_id = (u32)Hash(image, MEMORY_SIZE);
+
+#ifdef CHIP8_PROFILE
+	profile = Profile_Open(image_id);
+#endif
+}
+
+CHIP_8::~CHIP_8(void)
+{
+	delete recompiled;
+#ifdef CHIP8_PROFILE
+	Profile_Close(profile);
+#endif
+}
 
 /**
  * @brief Load a rom and store element into memory
- * @details return true if rom is correctely load else false
+ * @details The file is only read the first time, see Rom.cpp
  * @param path of the rom file
- * @return boolean
+ * @return true if rom is correctely load else false
  */
 bool CHIP_8::load(const char*file_path)
 {
-	std::cout<<"Loading Rom : "<<file_path<<"\n";
-
-    // Open ROM file
-    FILE* rom = fopen(file_path, "rb");
-    if (!rom) 
-	{
-        std::cerr << "Failed to open ROM" << std::endl;
+    const Rom *rom = Rom_Load(file_path);
+    if (!rom)
         return false;
+
+    load(*rom);
+    return true;
+}
+
+/**
+ * @brief Copy a rom into memory at START_ADRESS
+ * @details Memory after the rom is cleared, a previous rom leaves nothing behind
+ * @param rom read by Rom_Load
+ */
+void CHIP_8::load(const Rom &rom)
+{
+    memcpy(cpu.memory + START_ADRESS, rom.data, rom.size);
+    memset(cpu.memory + START_ADRESS + rom.size, 0, ROM_MAX_SIZE - rom.size);
+
+    // Save states are deltas of this image
+    memcpy(image, cpu.memory, MEMORY_SIZE);
+    image_id = (u32)Hash(image, MEMORY_SIZE);
+
+#ifdef CHIP8_PROFILE
+    Profile_Close(profile);
+    profile = Profile_Open(image_id);
+#endif
+
+    // Previous decoded and translated instructions are no longer valid
+    cpu.invalidate();
+    if (recompiled){
+        recompiled->flush();
     }
+    settled = false;
+}
+
+/**
+ * @brief Extract handler and operands of an opcode
+ * @param specialised see CHIP_8::specialised
+ */
+static void Decode(CPU::Decoded &ins, u16 opcode, bool specialised)
+{
+	ins.handler = Handler_Of(opcode, specialised);
+	ins.opcode  = opcode;
+	ins.nnn     = opcode & 0x0FFF;
+	ins.x       = (opcode & 0x0F00) >> 8;
+	ins.y       = (opcode & 0x00F0) >> 4;
+	ins.kk      = opcode & 0x00FF;
+	ins.n       = opcode & 0x000F;
+}
+
+/**
+ * @brief Decoded instruction at an even adress of memory
+ * @details The entry of cpu.cache is filled when it has been invalidated
+ * @param adress even and inside memory
+ */
+const CPU::Decoded &CHIP_8::decode(u16 adress)
+{
+	CPU::Decoded &ins = cpu.cache[adress >> 1];
+	if (!ins.handler){
+		Decode(ins, cpu.memory[adress] << 8 | cpu.memory[adress + 1], specialised);
+	}
+	return ins;
+}
 
-    // Get file size
-    fseek(rom, 0, SEEK_END);
-    long rom_size = ftell(rom);
-    rewind(rom);
+/**
+ * @brief Fetch opcode depending to memory and program counter and execute instruction
+ * @details
+ * Instructions at even adresses are decoded once and kept in cpu.cache until memory is written,
+ * so hot loops skip fetch and decode. Invalid opcodes set cpu.fault instead of leaving the program
+ * @see CPU.cpp
+ */
+void CHIP_8::emulate_cycle(void) 
+{
+	const u16 pc = cpu.pc;
+	CPU::Decoded *ins = &cpu.cache[(pc & (MEMORY_SIZE - 1)) >> 1];
 
-    // Allocate memory to store rom
-    char* rom_buffer = new char[rom_size];
-    if (!rom_buffer) 
+	if (pc & 1 || pc >= MEMORY_SIZE)
 	{
-        std::cerr << "Failed to allocate memory for ROM" << std::endl;
-        return false;
-    }
+		ins = &cpu.scratch;
+	}
+	if (ins == &cpu.scratch || !ins->handler)
+	{
+		// Fetch op code, it is two bytes
+		Decode(*ins, cpu.memory[pc & (MEMORY_SIZE - 1)] << 8 | cpu.memory[(pc + 1) & (MEMORY_SIZE - 1)], specialised);
+	}
+
+	cpu.ins    = ins;
+	cpu.opcode = ins->opcode;
+	cpu.pc    += 2;
+
+	// Execute it
+#ifdef CHIP8_PROFILE
+	const u64 start = Profile_Ticks();
+	ins->handler(cpu);
+	profile->record(pc, cpu.opcode, Profile_Ticks() - start);
+#else
+	ins->handler(cpu);
+#endif
+
+	if (trace){
+		trace->record(cpu, pc, ins->opcode);
+	}
+}
 
-    // Copy ROM into buffer
-    size_t result = fread(rom_buffer, sizeof(char), (size_t)rom_size, rom);
-    if (result != (size_t)rom_size) 
+/*
+ * Registers a run starts from, see CHIP_8::run
+ */
+struct Registers
+{
+	u8  V[NUMBER_REGISTER];
+	u16 I;
+	u16 pc;
+	u8  sp;
+	u8  delay_timer;
+	u8  sound_timer;
+	u32 rng;
+};
+
+/**
+ * @brief Copy the registers of the CPU
+ */
+static void Save_Registers(const CPU &cpu, Registers &registers)
+{
+	memcpy(registers.V, cpu.V, sizeof(registers.V));
+	registers.I           = cpu.I;
+	registers.pc          = cpu.pc;
+	registers.sp          = cpu.sp;
+	registers.delay_timer = cpu.delay_timer;
+	registers.sound_timer = cpu.sound_timer;
+	registers.rng         = cpu.rng;
+}
+
+/**
+ * @brief Whether the registers of the CPU are the saved ones
+ */
+static bool Same_Registers(const CPU &cpu, const Registers &registers)
+{
+	return cpu.pc == registers.pc && cpu.I == registers.I && cpu.sp == registers.sp &&
+	       cpu.delay_timer == registers.delay_timer && cpu.sound_timer == registers.sound_timer &&
+	       cpu.rng == registers.rng && memcmp(cpu.V, registers.V, sizeof(registers.V)) == 0;
+}
+
+/**
+ * @brief Execute a number of instructions with the selected engine
+ * @details
+ * Every engine stops after exactly cycles instructions, or sooner when the CPU faults.
+ * While Fx0A waits for a key nothing is dispatched, the cycles pass as if Fx0A was executed
+ * again and again, since keys only change between two calls. Idle loops at pc are skipped
+ * the same way, see skip_idle. A traced machine records those waits and skips no loop.
+ * A run ending with the registers it started from, having written neither memory nor the
+ * screen, is idle too: the next ones do the same until timers or keys change. Frames too
+ * short for skip_idle are then still seen waiting. Cycles spent waiting or skipped are
+ * counted in skipped
+ * @param cycles number of instructions to execute
+ * @return number of instructions executed
+ */
+unsigned long CHIP_8::run(unsigned long cycles)
+{
+	idle        = false;
+	fixed_point = false;
+
+	if (cpu.fault){
+		return 0;
+	}
+	if (waiting_key())
 	{
-        std::cerr << "Failed to read ROM" << std::endl;
-        return false;
-    }
+		if (trace){
+			trace->wait(cpu, cycles);
+		}
+		skipped += cycles;
+		return cycles;
+	}
 
-    // Copy buffer to memory
-    if ((MEMORY_SIZE-START_ADRESS) > rom_size)
+	// The written range and drawn rows of the caller are given back with the ones of this run
+	Registers before;
+	Save_Registers(cpu, before);
+	const u16 written_low  = cpu.written_low;
+	const u16 written_high = cpu.written_high;
+	const u32 dirty        = cpu.dirty;
+	cpu.written_low  = MEMORY_SIZE;
+	cpu.written_high = 0;
+	cpu.dirty        = 0;
+
+#ifdef CHIP8_PROFILE
+	unsigned long done = 0;
+#else
+	unsigned long done = trace ? 0 : skip_idle(cycles);
+#endif
+
+	cpu.waiting = false;
+	done += run_engine(cycles - done);
+
+	if (!cpu.waiting && !cpu.dirty && cpu.written_low > cpu.written_high && Same_Registers(cpu, before))
 	{
-        for (int i = 0; i < rom_size; ++i) 
-		{
-            // Load into memory starting
-			cpu.memory[i + START_ADRESS] = (u8)rom_buffer[i];   
-        }
-    }
-    else 
+		idle        = true;
+		fixed_point = true;
+	}
+	if (written_low < cpu.written_low)   cpu.written_low  = written_low;
+	if (written_high > cpu.written_high) cpu.written_high = written_high;
+	cpu.dirty |= dirty;
+
+	if (cpu.waiting)
 	{
-        std::cerr << "ROM too large to fit in memory" << std::endl;
-        return false;
-    }
+		cpu.waiting = false;
+		if (trace){
+			trace->wait(cpu, cycles - done);
+		}
+		skipped += cycles - done;
+		return cycles;
+	}
+	return done;
+}
 
-    // Clean up
-    fclose(rom);
-    delete rom_buffer;
-    return true;
+/**
+ * @brief Execute instructions with the selected engine until Fx0A waits for a key
+ * @details
+ * The static engine falls back to the interpreter when the rom was not recompiled.
+ * Profiled builds and traced machines always interpret, every instruction goes through emulate_cycle
+ * @param cycles number of instructions to execute at most
+ * @return number of instructions executed
+ */
+unsigned long CHIP_8::run_engine(unsigned long cycles)
+{
+#ifndef CHIP8_PROFILE
+	if (engine == ENGINE_THREADED && !trace){
+		return run_threaded(cycles);
+	}
+
+	// Roms which were not recompiled are interpreted
+	if (engine == ENGINE_STATIC && !trace)
+	{
+		if (!recompiled){
+			recompiled = new Static();
+		}
+		if (recompiled->select(image_id)){
+			return recompiled->run(*this, cycles);
+		}
+	}
+#endif
+
+	unsigned long done = 0;
+	while (done < cycles && !cpu.fault && !cpu.waiting)
+	{
+		emulate_cycle();
+		++done;
+	}
+	return done;
 }
 
 /**
- * @brief Jump opcode depending to memory and program counter and execute instruction
- * @see CPU.cpp
+ * @brief Whether an instruction only reads memory, timers and keys, and only writes V, I and pc
  */
-void CHIP_8::emulate_cycle(void) 
+static bool Is_Pure(u16 opcode)
 {
-	// Fetch op code
-    cpu.opcode = cpu.memory[cpu.pc] << 8 | cpu.memory[cpu.pc + 1];   // Op code is two bytes
-	
-    cpu.pc+=2;
-	switch(cpu.opcode & 0xF000)
+	const u8 kk = opcode & 0x00FF;
+
+	switch (opcode & 0xF000)
 	{
-		case 0x0000:
-				switch (cpu.opcode & 0x000F) 
-				{
-					case 0x0000:
-						cpu.OP_00E0();
-						drawFlag=true;
-						break;
-
-					case 0x000E:
-						cpu.OP_00EE();
-						break;
-
-					default:
-						printf("\nUnknown op code: %.4X\n", cpu.opcode);
-						exit(3);
-				}
-        break;
-		
-        case 0x1000:
-            cpu.OP_1nnn();
-            break;
-
-		case 0x2000:
-            cpu.OP_2nnn();
-            break;
-
-        case 0x3000:
-            cpu.OP_3xkk();
-            break;
-
-        case 0x4000:
-            cpu.OP_4xkk();
-            break;
-
-        case 0x5000:
-            cpu.OP_5xy0();
-            break;
-
-        case 0x6000:
-            cpu.OP_6xkk();
-            break;
-
-        case 0x7000:
-            cpu.OP_7xkk();
-            break;
-
-        case 0x8000:
-            switch (cpu.opcode & 0x000F) 
-			{
-				case 0x0000:
-                    cpu.OP_8xy0();
-                    break;
-
-                case 0x0001:
-                    cpu.OP_8xy1();
-                    break;
-
-                case 0x0002:
-                    cpu.OP_8xy2();
-                    break;
-
-                case 0x0003:
-                    cpu.OP_8xy3();
-                    break;
-
-                case 0x0004:
-                    cpu.OP_8xy4();
-                    break;
-
-				case 0x0005:
-                    cpu.OP_8xy5();
-                    break;
-
-				case 0x0006:
-                    cpu.OP_8xy6();
-                    break;
-
-                case 0x0007:
-                    cpu.OP_8xy7();
-                    break;
-				
-				case 0x000E:
-                    cpu.OP_8xyE();
-                    break;
-
-                default:
-                    printf("\nUnknown op code: %.4X\n", cpu.opcode);
-                    exit(3);
-            }
-            break;
-
-        case 0x9000:
-            cpu.OP_9xy0();
-            break;
-
-       case 0xA000:
-            cpu.OP_Annn();
-            break;
-
-        case 0xB000:
-            cpu.OP_Bnnn();
-            break;
-
-        case 0xC000:
-            cpu.OP_Cxkk();
-            break;
-
-        case 0xD000:
-			cpu.OP_Dxyn();
-			drawFlag=true;
+		case 0x1000:
+		case 0x3000:
+		case 0x4000:
+		case 0x5000:
+		case 0x6000:
+		case 0x7000:
+		case 0x9000:
+		case 0xA000:
+		case 0xB000:
+			return true;
+
+		case 0x8000:
+			return (opcode & 0x000F) <= 0x7 || (opcode & 0x000F) == 0xE;
+
+		case 0xE000:
+			return kk == 0x9E || kk == 0xA1;
+
+		case 0xF000:
+			return kk == 0x07 || kk == 0x1E || kk == 0x29 || kk == 0x65;
+
+		default:
+			// 0nnn, 2nnn, Cxkk, Dxyn
+			return false;
+	}
+}
+
+/**
+ * @brief Execute the loop at pc once and skip its next iterations when nothing changed
+ * @details
+ * Roms wait for the delay timer or a key with short loops such as Fx07, 3xkk, 1nnn, or end
+ * on a jump to itself. When the instructions from pc come back to pc with the same V and I
+ * while writing nothing else, every iteration does the same until timers or keys change,
+ * which only happens between two runs. Those iterations are skipped, only the rest of a
+ * partial iteration is left to the engine so every engine ends in the same state.
+ * Code which does not reach a jump back to pc within IDLE_LENGTH instructions is left at once,
+ * and so are runs too short to skip anything once the loop ran twice
+ * @param cycles number of instructions to execute at most
+ * @return number of instructions executed or skipped
+ */
+unsigned long CHIP_8::skip_idle(unsigned long cycles)
+{
+	const u16 start = cpu.pc;
+
+	if (cycles < 4 * IDLE_LENGTH){
+		return 0;
+	}
+
+	for(unsigned i = 0;; ++i)
+	{
+		const u16 pc     = start + 2 * i;
+		const u16 opcode = cpu.memory[pc & (MEMORY_SIZE - 1)] << 8 | cpu.memory[(pc + 1) & (MEMORY_SIZE - 1)];
+
+		if (i == IDLE_LENGTH || !Is_Pure(opcode))
+			return 0;
+		if ((opcode & 0xF000) == 0x1000 && (opcode & 0x0FFF) <= start && start - (opcode & 0x0FFF) < 2 * IDLE_LENGTH)
 			break;
+	}
 
-        case 0xE000:
-			switch (cpu.opcode & 0x00FF) 
-			{
-                case 0x009E:
-                    cpu.OP_Ex9E();
-                    break;
-
-				case 0x00A1:
-                    cpu.OP_ExA1();
-                    break;
-
-                default:
-                    printf("\nUnknown op code: %.4X\n", cpu.opcode);
-                    exit(3);
-            }
-            break;
-
-        case 0xF000:
-            switch (cpu.opcode & 0x00FF)
-            {
-                case 0x0007:
-                    cpu.OP_Fx07();
-					break;
-
-                case 0x000A:
-					cpu.OP_Fx0A();
-					break;
-
-                case 0x0015:
-                    cpu.OP_Fx15();
-					break;
-
-                case 0x0018:
-                   break;
-
-				case 0x001E:
-                    cpu.OP_Fx1E();
-					break;
-					
-				case 0x0029:
-                    cpu.OP_Fx29();
-					break;
-
-                case 0x0033:
-                    cpu.OP_Fx33();
-					break;
-
-				case 0x0055:
-                    cpu.OP_Fx55();
-					break;
-
-                case 0x0065:
-                    cpu.OP_Fx65();
-					break;
-
-                default:
-                    printf ("Unknown opcode [0xF000]: 0x%X\n", cpu.opcode);
-            }
-            break;
-
-        default:
-            printf("\nUnimplemented op code: %.4X\n", cpu.opcode);
-            exit(3);
-    }
-	
-	// Update timers
-    if (cpu.delay_timer > 0){
-        --cpu.delay_timer;
+	unsigned long done = 0;
+
+	// The first iteration may still change registers, Fx07 reads a timer which just ticked
+	for(unsigned pass = 0; pass < 2; ++pass)
+	{
+		const u16 I = cpu.I;
+		u8 V[NUMBER_REGISTER];
+
+		memcpy(V, cpu.V, sizeof(V));
+
+		unsigned long length = 0;
+		while (done + length < cycles && length < IDLE_LENGTH)
+		{
+			const u16 pc = cpu.pc;
+			if (!Is_Pure(cpu.memory[pc & (MEMORY_SIZE - 1)] << 8 | cpu.memory[(pc + 1) & (MEMORY_SIZE - 1)]))
+				break;
+
+			emulate_cycle();
+			++length;
+
+			if (cpu.pc == start)
+				break;
+		}
+		done += length;
+
+		if (length == 0 || cpu.pc != start)
+			return done;
+
+		if (cpu.I == I && memcmp(V, cpu.V, sizeof(V)) == 0)
+		{
+			const unsigned long skip = (cycles - done) / length * length;
+
+			idle     = true;
+			skipped += skip;
+			return done + skip;
+		}
 	}
-	
-	if(cpu.sound_timer > 0){
-		--cpu.sound_timer;
+	return done;
+}
+
+/**
+ * @brief Whether the next instruction is Fx0A and no key is pressed
+ * @details Executing it would only come back to it, run skips it until a key is pressed
+ */
+bool CHIP_8::waiting_key(void) const
+{
+	const u16 pc     = cpu.pc;
+	const u16 opcode = cpu.memory[pc & (MEMORY_SIZE - 1)] << 8 | cpu.memory[(pc + 1) & (MEMORY_SIZE - 1)];
+
+	if ((opcode & 0xF0FF) != 0xF00A)
+		return false;
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i)
+	{
+		if (cpu.key[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Keys pressed, bit n for key n
+ */
+static u16 Key_Mask(const CPU &cpu)
+{
+	u16 keys = 0;
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		keys |= (cpu.key[i] != 0) << i;
 	}
+	return keys;
 }
-	
 
+/**
+ * @brief Execute the instructions of a frame then decrease timers
+ * @details
+ * Timers run at 60 hertz whatever the number of instructions per frame. A frame which came
+ * back to the state it started from, or left Fx0A waiting, with timers stopped before and
+ * after it, settles the machine: the next frames with the same keys would run the same
+ * instructions from the same state, so they are counted without running until keys change.
+ * Traced and profiled machines run every frame
+ * @return number of instructions executed
+ */
+unsigned long CHIP_8::run_frame(void)
+{
+	if (settled && cycles_per_frame == settled_cycles && Key_Mask(cpu) == settled_keys)
+	{
+		skipped += cycles_per_frame;
+		return cycles_per_frame;
+	}
 
+	const bool stopped = !cpu.delay_timer && !cpu.sound_timer;
+	unsigned long done = run(cycles_per_frame);
 
+	tick_timers();
 
-	
-	
+#ifdef CHIP8_PROFILE
+	settled = false;
+#else
+	settled = !trace && !cpu.fault && stopped && !cpu.delay_timer && !cpu.sound_timer && (fixed_point || waiting_key());
+#endif
 
+	// Keys do not change during a frame
+	if (settled)
+	{
+		settled_keys   = Key_Mask(cpu);
+		settled_cycles = cycles_per_frame;
+	}
+	return done;
+}
 
+/**
+ * @brief Decrease timers which are not zero, called once per frame
+ */
+void CHIP_8::tick_timers(void)
+{
+	if (cpu.delay_timer > 0){
+		--cpu.delay_timer;
+	}
 
-	
-	
-	
\ No newline at end of file
+	if (cpu.sound_timer > 0){
+		--cpu.sound_timer;
+	}
+}
@@ -1,11 +1,71 @@
 /**
  * @file CHIP_8.hpp
  * @brief Composition of CHIP-8
- * @see CHIP_8.cpp 
+ * @see CHIP_8.cpp
  */
 #ifndef CHIP_8_HPP
 #define CHIP_8_HPP
-#include "CPU/CPU.HPP"
+#include "CPU/CPU.hpp"
+#include "Rom.hpp"
+#include "Profile.hpp"
+
+/*
+ * Frames per second, timers are decreased once per frame
+ */
+#define FRAME_RATE 60
+
+/*
+ * Instructions executed during a frame by default, about 600 per second
+ */
+#define CYCLES_PER_FRAME 10
+
+/*
+ * Longest loop, in instructions, whose iterations run can skip
+ */
+#define IDLE_LENGTH 8
+
+/*
+ * Version of the save state format, a state of another version is refused
+ */
+#define STATE_VERSION 1
+
+/*
+ * Largest save state, when neither memory nor screen compress at all
+ */
+#define STATE_MAX_SIZE (128 + MEMORY_SIZE + L * 8)
+
+/*
+ * Blocks of the roms recompiled before building, see Static.hpp
+ */
+struct Static;
+
+/*
+ * Recorder of executed instructions, see Trace.hpp
+ */
+struct Trace_Writer;
+
+/*
+ * Way instructions are executed by CHIP_8::run
+ */
+enum Engine
+{
+	ENGINE_INTERPRETER,
+	ENGINE_THREADED,
+	ENGINE_STATIC
+};
+
+/**
+ * @brief Name of an engine, as given on the command line
+ * @see   CHIP_8.cpp
+ */
+const char *Engine_Name(Engine engine);
+
+/**
+ * @brief Engine of a name given on the command line
+ * @see   CHIP_8.cpp
+ * @return false when the name is unknown
+ */
+bool Engine_From_Name(const char *name, Engine &engine);
 
 struct CHIP_8
 {
@@ -13,24 +73,170 @@ struct CHIP_8
 	 * CPU of CHIP-8 which contains all instructions and components
 	 */
 	CPU cpu;
-	
+
+	/*
+	 * Engine used by run, the interpreter by default
+	 */
+	Engine engine;
+
+	/*
+	 * Recompiled blocks of the rom, created the first time the static engine runs
+	 */
+	Static *recompiled;
+
+	/*
+	 * Instructions executed by run_frame, CYCLES_PER_FRAME by default
+	 */
+	unsigned long cycles_per_frame;
+
+	/*
+	 * Decode instructions naming registers to handlers specialised on them, true by default,
+	 * otherwise handlers read their registers from the decoded instruction.
+	 * Only instructions decoded after it changes follow it, set it before load
+	 */
+	bool specialised;
+
+	/*
+	 * Memory right after the rom was loaded, save states only keep what differs from it
+	 */
+	u8 image[MEMORY_SIZE];
+
+	/*
+	 * Hash of image, a state is only restored over the image it was saved from
+	 */
+	u32 image_id;
+
+	/*
+	 * Set when the last run skipped the iterations of a loop which only waits for timers or keys,
+	 * or came back to the registers it started from without writing memory or the screen
+	 */
+	bool idle;
+
+	/*
+	 * Set when the last run came back to the registers it started from without writing memory
+	 * or the screen, the next one with the same keys does exactly the same
+	 */
+	bool fixed_point;
+
+	/*
+	 * Set when the last frame came back to where it started or left Fx0A waiting, with timers
+	 * stopped before and after it. run_frame then only counts the next frames until keys or
+	 * cycles_per_frame change, running them would leave the machine as it is
+	 */
+	bool          settled;
+	u16           settled_keys;    /* Keys pressed during that frame, bit n for key n */
+	unsigned long settled_cycles;  /* cycles_per_frame of that frame */
+
 	/*
-	 * To know if some pixels has drawn
+	 * Instructions counted by runs without being executed since the machine was created:
+	 * skipped iterations of idle loops, cycles waiting for a key and frames skipped once settled
 	 */
-	bool drawFlag;
-	
+	unsigned long skipped;
+
+	/*
+	 * Receives every executed instruction when set, run then always interprets
+	 */
+	Trace_Writer *trace;
+
+#ifdef CHIP8_PROFILE
+	/*
+	 * Executions and host time of each adress since the rom was loaded
+	 */
+	Profile *profile;
+#endif
+
+	CHIP_8(void);
+	~CHIP_8(void);
+
+	/* Translated code belongs to one machine */
+	CHIP_8(const CHIP_8&) = delete;
+	CHIP_8 &operator=(const CHIP_8&) = delete;
+
 	/**
 	 * @brief Load a rom
 	 * @see   CHIP_8.cpp
 	 */
 	bool load(const char*file_path);
-	
+
+	/**
+	 * @brief Load a rom already read
+	 * @see   CHIP_8.cpp
+	 */
+	void load(const Rom &rom);
+
 	/**
 	 * @brief Jump opcode and choose instructions
 	 * @see   CHIP_8.cpp
 	 * @see   CPU.cpp
 	 */
 	void emulate_cycle(void);
+
+	/**
+	 * @brief Execute instructions with the selected engine
+	 * @see   CHIP_8.cpp
+	 * @return number of instructions executed
+	 */
+	unsigned long run(unsigned long cycles);
+
+	/**
+	 * @brief Execute instructions with the selected engine until Fx0A waits for a key
+	 * @see   CHIP_8.cpp
+	 * @return number of instructions executed
+	 */
+	unsigned long run_engine(unsigned long cycles);
+
+	/**
+	 * @brief Execute the loop at pc once and skip its next iterations when nothing changed
+	 * @see   CHIP_8.cpp
+	 * @return number of instructions executed or skipped
+	 */
+	unsigned long skip_idle(unsigned long cycles);
+
+	/**
+	 * @brief Whether the next instruction is Fx0A and no key is pressed
+	 * @see   CHIP_8.cpp
+	 */
+	bool waiting_key(void) const;
+
+	/**
+	 * @brief Execute the instructions of a frame then decrease timers, unless the machine settled
+	 * @see   CHIP_8.cpp
+	 * @return number of instructions executed
+	 */
+	unsigned long run_frame(void);
+
+	/**
+	 * @brief Decrease timers, called once per frame
+	 * @see   CHIP_8.cpp
+	 */
+	void tick_timers(void);
+
+	/**
+	 * @brief Write the state of the machine into buffer
+	 * @see   State.cpp
+	 * @return size of the state, 0 when buffer is too small
+	 */
+	unsigned long save(u8 *buffer, unsigned long capacity) const;
+
+	/**
+	 * @brief Restore a state written by save
+	 * @see   State.cpp
+	 * @return false when the state is invalid or belongs to another rom, the machine is unchanged
+	 */
+	bool restore(const u8 *buffer, unsigned long size);
+
+	/**
+	 * @brief Execute instructions with the threaded interpreter
+	 * @see   Threaded.cpp
+	 * @return number of instructions executed
+	 */
+	unsigned long run_threaded(unsigned long cycles);
+
+	/**
+	 * @brief Decoded instruction at an even adress, decoded on first use
+	 * @see   CHIP_8.cpp
+	 */
+	const CPU::Decoded &decode(u16 adress);
 };
 
 
@@ -4,8 +4,8 @@
  * @see   http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
  */
 #include "CPU.hpp"
-#include <time.h>
 #include <cstring>
+#include <utility>
 
 static constexpr const unsigned char chip8_fontset[NUMBER_FONTSET] =
 {
@@ -40,6 +40,21 @@ CPU::CPU(void)
 	I      = 0;
 	sp     = 0;
 	
+	// The screen has never been presented
+	dirty    = ~0u;
+	fault    = false;
+	waiting  = false;
+	ins      = nullptr;
+	scratch.handler = nullptr;
+
+	// Nothing faulted yet
+	fault_pc     = 0;
+	fault_opcode = 0;
+
+	// Nothing written yet
+	written_low  = MEMORY_SIZE;
+	written_high = 0;
+	
 	// Clear the display
 	memset(gfx,0,sizeof(gfx));
 	
@@ -59,49 +74,76 @@ CPU::CPU(void)
 	}
 	
 	delay_timer = 0;
+	sound_timer = 0;
+	
+	// Nothing is decoded yet
+	invalidate();
 	
-	// To control the choice of the seed
-	srand(time(NULL));
+	// Same sequence on every run unless another seed is chosen
+	seed(DEFAULT_SEED);
+}
+
+/**
+ * @brief Forget every decoded instruction, used when the whole memory is rewritten
+ */
+void CPU::invalidate(void)
+{
+	for(unsigned i = 0; i < MEMORY_SIZE / 2; ++i){
+		cache[i].handler = nullptr;
+	}
 }
 
+/*
+ * Operands are extracted once when the instruction is decoded
+ */
+
 /*
  * A 12-bit value, the lowest 12 bits of the instruction
  */
-#define nnn (opcode & 0x0FFF)
+#define nnn (ins->nnn)
 
 
 /*
- * A 4-bit value, the lower 4 bits of the high byte of the instruction
+ * A 4-bit value, the lower 4 bits of the high byte of the instruction,
+ * a constant in handlers specialised on it
  */
-#define x ((opcode & 0x0F00) >> 8)
+#define x (X != DECODED_REGISTER ? X : ins->x)
 
 /*
- * A 4-bit value, the upper 4 bits of the low byte of the instruction
+ * A 4-bit value, the upper 4 bits of the low byte of the instruction,
+ * a constant in handlers specialised on it
  */
-#define y ((opcode & 0x00F0) >> 4)
+#define y (Y != DECODED_REGISTER ? Y : ins->y)
 
 /*
  * An 8-bit value, the lowest 8 bits of the instruction
  */
-#define kk (opcode & 0x00FF)
+#define kk (ins->kk)
 
 /* List of Instructions : http://devernay.free.fr/hacks/chip8/C8TECH10.HTM */
 
 /**
  * @brief Clear the display
  */
-void CPU::OP_00E0(void){ 
-	memset(gfx,0,sizeof(gfx));    
+void CPU::OP_00E0(void)
+{ 
+	memset(gfx,0,sizeof(gfx));
+	dirty = ~0u;
 }
 
 /**
  * @brief Return from a subroutine
  * @details
  * The interpreter sets the program counter to the address at the top of the stack 
- * then subtracts 1 from the stack pointer
+ * then subtracts 1 from the stack pointer.
+ * An empty stack faults like an invalid opcode
  */
 void CPU::OP_00EE(void)
 { 
+	if (sp == 0){
+		OP_Invalid();
+		return;
+	}
 	sp--; 
 	pc=stack[sp];          
 }
@@ -120,10 +162,15 @@ void CPU::OP_1nnn(void){
  * @details
  * The interpreter increments the stack pointer
  * then puts the current PC on the top of the stack 
- * the PC is then set to nnn
+ * the PC is then set to nnn.
+ * A full stack faults like an invalid opcode
  */
 void CPU::OP_2nnn(void)
 { 
+	if (sp >= NUMBER_REGISTER){
+		OP_Invalid();
+		return;
+	}
 	stack[sp]=pc; 
 	++sp; 
 	pc = nnn; 
@@ -135,6 +182,7 @@ void CPU::OP_2nnn(void)
  * The interpreter compares register Vx to kk 
  * and if they are equal increments the program counter by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_3xkk(void){ 
 	pc+= (V[x] == kk) ? 2 : 0;    
 }
@@ -145,6 +193,7 @@ void CPU::OP_3xkk(void){
  * The interpreter compares register Vx to kk
  * and if they are not equal, increments the program counter by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_4xkk(void){ 
 	pc+= (V[x] != kk) ? 2 : 0;   
 }
@@ -155,6 +204,7 @@ void CPU::OP_4xkk(void){
  * The interpreter compares register Vx to register Vy
  * and if they are equal, increments the program counter by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_5xy0(void){ 
 	pc+= (V[x] == V[y]) ? 2 : 0; 
 }
@@ -164,6 +214,7 @@ void CPU::OP_5xy0(void){
  * @details
  * The interpreter puts the value kk into register Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_6xkk(void){ 
 	V[x] = kk;					 
 }
@@ -174,6 +225,7 @@ void CPU::OP_6xkk(void){
  * Adds the value kk to the value of register Vx 
  * then stores the result in Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_7xkk(void){ 
 	V[x] += kk;                    
 }
@@ -183,6 +235,7 @@ void CPU::OP_7xkk(void){
  * @details
  * Stores the value of register Vy in register Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy0(void){ 
 	V[x] = V[y];                   
 }
@@ -194,6 +247,7 @@ void CPU::OP_8xy0(void){
  * A bitwise OR compares the corrseponding bits from two values and if either bit is 1
  * then the same bit in the result is also 1. Otherwise, it is 0
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy1(void){ 
 	V[x] |= V[y];                  
 }
@@ -207,6 +261,7 @@ void CPU::OP_8xy1(void){
  * A bitwise AND compares the corrseponding bits from two values and if both bits are 1
  * then the same bit in the result is also 1. Otherwise, it is 0
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy2(void){ 
 	V[x] &= V[y];                  
 }
@@ -218,6 +273,7 @@ void CPU::OP_8xy2(void){
  * An exclusive OR compares the corrseponding bits from two values, and if the bits are not both the same
  * then the corresponding bit in the result is set to 1. Otherwise, it is 0
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy3(void){ 
 	V[x] ^= V[y];                  
 }
@@ -229,6 +285,7 @@ void CPU::OP_8xy3(void){
  * If the result is greater than 8 bits
  * F is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy4(void)
 { 
 	V[x]  += V[y]; 
@@ -241,6 +298,7 @@ void CPU::OP_8xy4(void)
  * If Vx > Vy, then VF is set to 1, otherwise 0
  * Then Vy is subtracted from Vx, and the results stored in Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy5(void)
 { 
 	V[0xF] = (V[x] > V[y]) ? 1 : 0; 
@@ -254,6 +312,7 @@ void CPU::OP_8xy5(void)
  * then VF is set to 1, otherwise 0
  * Then Vx is divided by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy6(void)
 { 
 	V[0xF] = V[x] & 0x1; 
@@ -266,6 +325,7 @@ void CPU::OP_8xy6(void)
  * If Vy > Vx, then VF is set to 1, otherwise 0
  * Then Vx is subtracted from Vy, and the results stored in Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xy7(void)
 { 
 	V[0xF] = (V[y] > V[x]) ? 1 : 0; 
@@ -278,6 +338,7 @@ void CPU::OP_8xy7(void)
  * If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0
  * Then Vx is multiplied by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_8xyE(void)
 { 
 	V[0xF] = V[x] >> 7; 
@@ -290,6 +351,7 @@ void CPU::OP_8xyE(void)
  * The values of Vx and Vy are compared, and if they are not equal, 
  * the program counter is increased by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_9xy0(void){ 
 	pc += (V[x] != V[y]) ? 2 : 0;                          
 }
@@ -317,8 +379,9 @@ void CPU::OP_Bnnn(void){
  * The interpreter generates a random number from 0 to 255 which is then ANDed with the value kk
  * The results are stored in Vx. See instruction 8xy2 for more information on AND
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Cxkk(void){ 
-	V[x] = (rand() % (0xFF + 1)) & kk;
+	V[x] = random() & kk;
 }
 
 /**
@@ -330,30 +393,38 @@ void CPU::OP_Cxkk(void){
  * positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side
  * of the screen.
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Dxyn(void)
 {
-	unsigned short X = V[x];
-	unsigned short Y = V[y];
-	unsigned short height = opcode & 0x000F;
-	unsigned short pixel;
+	V[0xF] = draw(V[x], V[y], I, ins->n);
+}
+
+/**
+ * @brief XOR a sprite of height rows read at adress onto the screen at (column, row)
+ * @details Coordinates wrap around the screen, so does the sprite
+ * @return 1 when a lit pixel was erased, 0 otherwise
+ */
+u8 CPU::draw(u8 column, u8 row, u16 adress, unsigned height)
+{
+	const unsigned X = column % l;
+	const unsigned Y = row % L;
+	u8 collision = 0;
 
-	V[0xF] = 0;
 	for (unsigned yline = 0; yline < height; yline++)
 	{
-		pixel = memory[I + yline];
-		for(unsigned xline = 0; xline < 8; xline++)
+		// Sprite row moved to its column, the rotation wraps it around the screen
+		u64 sprite = (u64)memory[(adress + yline) & (MEMORY_SIZE - 1)] << (l - 8);
+		sprite = (sprite >> X) | (sprite << ((l - X) & (l - 1)));
+
+		const unsigned line = (Y + yline) % L;
+		if (gfx[line] & sprite)
 		{
-			if((pixel & (l*2 >> xline)) != 0)
-			{
-				if(gfx[(X + xline + ((Y + yline) * l))] == 1)
-				{
-					V[0xF] = 1;
-				}
-				gfx[X + xline + ((Y + yline) * l)] ^= 1;
-			}
+			collision = 1;
 		}
+		gfx[line] ^= sprite;
+		dirty     |= 1u << line;
 	}
-	
+	return collision;
 }
 
 /**
@@ -362,6 +433,7 @@ void CPU::OP_Dxyn(void)
  * Checks the keyboard, and if the key corresponding to the value of Vx
  * is currently in the down position, PC is increased by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Ex9E(void){
 	pc += key[V[x]] ? 2 : 0;
 }
@@ -372,6 +444,7 @@ void CPU::OP_Ex9E(void){
  * Checks the keyboard, and if the key corresponding to the value of Vx is currently
  * in the up position, PC is increased by 2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_ExA1(void){
 	pc += !key[V[x]] ? 2 : 0;
 }
@@ -381,6 +454,7 @@ void CPU::OP_ExA1(void){
  * @details
  * The value of DT is placed into Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx07(void){
 	V[x] = delay_timer;
 }
@@ -388,8 +462,10 @@ void CPU::OP_Fx07(void){
 /**
  * @brief Wait for a key press, store the value of the key in Vx
  * @details 
- * All execution stops until a key is pressed, then the value of that key is stored in Vx
+ * All execution stops until a key is pressed, then the value of that key is stored in Vx.
+ * The program counter stays on this instruction and the engine stops until keys change
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx0A(void)
 {
 	bool key_pressed = false;
@@ -403,9 +479,10 @@ void CPU::OP_Fx0A(void)
 		}
 	}
 
-	// If no key is pressed, decrement and try again.
+	// If no key is pressed, decrement and try again once keys changed
 	if(!key_pressed){
 		pc -=2;
+		waiting = true;
 	}
 }
 
@@ -414,10 +491,12 @@ void CPU::OP_Fx0A(void)
  * @details
  * Delay Timer is set equal to the value of Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx15(void){
 	delay_timer = V[x];
 }
 
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx18(void){
 	sound_timer=V[x];	
 }
@@ -425,6 +504,7 @@ void CPU::OP_Fx18(void){
 /**
  * @brief Set I = I + Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx1E(void){
 	I += V[x];
 }
@@ -434,6 +514,7 @@ void CPU::OP_Fx1E(void){
  * @details
  * The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx29(void){
 	I = V[x] * 0x5;
 }
@@ -444,12 +525,16 @@ void CPU::OP_Fx29(void){
  * The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I
  * the tens digit at location I+1, and the ones digit at location I+2
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx33(void)
 {
-	memory[I]     = V[x] / 100;
-	memory[I + 1] = (V[x] / 10) % 10;
-	memory[I + 2] = V[x] % 10;
+	memory[I & (MEMORY_SIZE - 1)]       = V[x] / 100;
+	memory[(I + 1) & (MEMORY_SIZE - 1)] = (V[x] / 10) % 10;
+	memory[(I + 2) & (MEMORY_SIZE - 1)] = V[x] % 10;
 	
+	invalidate(I);
+	invalidate(I + 2);
+	wrote(I, 3);
 }
 
 /** 
@@ -457,11 +542,14 @@ void CPU::OP_Fx33(void)
  * @details
  * The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx55(void)
 {
-	for (int i = 0; i <= (x); ++i){
-		memory[I + i] = V[i];
+	for (unsigned i = 0; i <= (x); ++i){
+		memory[(I + i) & (MEMORY_SIZE - 1)] = V[i];
+		invalidate(I + i);
 	}
+	wrote(I, x + 1);
 }
 
 /**
@@ -469,9 +557,152 @@ void CPU::OP_Fx55(void)
  * @details 
  * The interpreter reads values from memory starting at location I into registers V0 through Vx
  */
+template<unsigned X, unsigned Y>
 void CPU::OP_Fx65(void)
 {
-	for (int i = 0; i <= (x); ++i){
-		V[i] = memory[I + i];
+	for (unsigned i = 0; i <= (x); ++i){
+		V[i] = memory[(I + i) & (MEMORY_SIZE - 1)];
+	}
+}
+
+/**
+ * @brief Shared handler of every invalid opcode
+ * @details
+ * The CPU is marked as faulted and the program counter goes back on the faulting instruction,
+ * the caller decides to stop or not the emulation and whether to report it
+ */
+void CPU::OP_Invalid(void)
+{
+	raise_fault(pc - 2, ins->opcode);
+}
+
+#undef kk
+#undef y
+#undef x
+#undef nnn
+
+/**
+ * @brief Plain function calling an instruction of the CPU, the tables store these instead of member pointers
+ */
+template<void (CPU::*op)(void)>
+static void Execute(CPU &cpu){
+	(cpu.*op)();
+}
+
+/*
+ * Handlers of every opcode indexed by the opcode, built once at startup so that an instruction
+ * is dispatched with a single indirect call. They are only read when an instruction is decoded,
+ * so their size does not weigh on the cache while instructions run
+ */
+struct Dispatch_Table
+{
+	CPU::Handler decoded[0x10000];      /* Registers read from the decoded instruction */
+	CPU::Handler specialised[0x10000];  /* Registers known at compile time */
+
+	Dispatch_Table(void);
+};
+
+/**
+ * @brief Give the opcodes naming registers X and Y their handlers
+ * @details
+ * Instructions naming X alone are filled for the 16 values of kk starting with Y, 5xyn and 9xyn
+ * compare the registers whatever n
+ * @param xy register bits of the opcodes, X << 8 | Y << 4
+ */
+template<unsigned X, unsigned Y>
+static void Fill_Registers(CPU::Handler *handler, unsigned xy)
+{
+	handler[0x8000 | xy] = Execute<&CPU::OP_8xy0<X, Y>>;
+	handler[0x8001 | xy] = Execute<&CPU::OP_8xy1<X, Y>>;
+	handler[0x8002 | xy] = Execute<&CPU::OP_8xy2<X, Y>>;
+	handler[0x8003 | xy] = Execute<&CPU::OP_8xy3<X, Y>>;
+	handler[0x8004 | xy] = Execute<&CPU::OP_8xy4<X, Y>>;
+	handler[0x8005 | xy] = Execute<&CPU::OP_8xy5<X, Y>>;
+	handler[0x8006 | xy] = Execute<&CPU::OP_8xy6<X, Y>>;
+	handler[0x8007 | xy] = Execute<&CPU::OP_8xy7<X, Y>>;
+	handler[0x800E | xy] = Execute<&CPU::OP_8xyE<X, Y>>;
+
+	for(unsigned low = 0; low < 16; ++low)
+	{
+		handler[0x5000 | xy | low] = Execute<&CPU::OP_5xy0<X, Y>>;
+		handler[0x9000 | xy | low] = Execute<&CPU::OP_9xy0<X, Y>>;
+		handler[0x3000 | xy | low] = Execute<&CPU::OP_3xkk<X, Y>>;
+		handler[0x4000 | xy | low] = Execute<&CPU::OP_4xkk<X, Y>>;
+		handler[0x6000 | xy | low] = Execute<&CPU::OP_6xkk<X, Y>>;
+		handler[0x7000 | xy | low] = Execute<&CPU::OP_7xkk<X, Y>>;
+		handler[0xC000 | xy | low] = Execute<&CPU::OP_Cxkk<X, Y>>;
+		handler[0xD000 | xy | low] = Execute<&CPU::OP_Dxyn<X, Y>>;
+	}
+
+	if ((xy & 0x00F0) == 0)
+	{
+		handler[0xE09E | xy] = Execute<&CPU::OP_Ex9E<X, Y>>;
+		handler[0xE0A1 | xy] = Execute<&CPU::OP_ExA1<X, Y>>;
+
+		handler[0xF007 | xy] = Execute<&CPU::OP_Fx07<X, Y>>;
+		handler[0xF00A | xy] = Execute<&CPU::OP_Fx0A<X, Y>>;
+		handler[0xF015 | xy] = Execute<&CPU::OP_Fx15<X, Y>>;
+		handler[0xF018 | xy] = Execute<&CPU::OP_Fx18<X, Y>>;
+		handler[0xF01E | xy] = Execute<&CPU::OP_Fx1E<X, Y>>;
+		handler[0xF029 | xy] = Execute<&CPU::OP_Fx29<X, Y>>;
+		handler[0xF033 | xy] = Execute<&CPU::OP_Fx33<X, Y>>;
+		handler[0xF055 | xy] = Execute<&CPU::OP_Fx55<X, Y>>;
+		handler[0xF065 | xy] = Execute<&CPU::OP_Fx65<X, Y>>;
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Specialise the handlers of every pair of registers, XY is X << 4 | Y
+ */
+template<size_t... XY>
+static void Fill_All(CPU::Handler *handler, std::index_sequence<XY...>)
+{
+	(Fill_Registers<(XY >> 4), (XY & 0x0F)>(handler, XY << 4), ...);
+}
+
+/**
+ * @brief Fill both tables, opcodes which are not listed go to CPU::OP_Invalid
+ * @details
+ * The specialised table starts as a copy of the decoded one, then the opcodes naming registers
+ * get the handler specialised on them
+ */
+Dispatch_Table::Dispatch_Table(void)
+{
+	for(unsigned opcode = 0; opcode < 0x10000; ++opcode){
+		decoded[opcode] = Execute<&CPU::OP_Invalid>;
+	}
+
+	for(unsigned nnn = 0; nnn < 0x1000; ++nnn)
+	{
+		decoded[0x1000 | nnn] = Execute<&CPU::OP_1nnn>;
+		decoded[0x2000 | nnn] = Execute<&CPU::OP_2nnn>;
+		decoded[0xA000 | nnn] = Execute<&CPU::OP_Annn>;
+		decoded[0xB000 | nnn] = Execute<&CPU::OP_Bnnn>;
+	}
+
+	// Only the low nibble of the system group is decoded, 0nn0 clears the screen and 0nnE returns
+	for(unsigned nn = 0; nn < 0x100; ++nn)
+	{
+		decoded[0x0000 | nn << 4] = Execute<&CPU::OP_00E0>;
+		decoded[0x000E | nn << 4] = Execute<&CPU::OP_00EE>;
+	}
+
+	for(unsigned xy = 0; xy < 0x1000; xy += 0x10){
+		Fill_Registers<DECODED_REGISTER, DECODED_REGISTER>(decoded, xy);
+	}
+
+	memcpy(specialised, decoded, sizeof(decoded));
+	Fill_All(specialised, std::make_index_sequence<256>());
+}
+
+static const Dispatch_Table dispatch;
+
+/**
+ * @brief Handler of an opcode
+ * @param specialised true for the handler knowing its registers at compile time,
+ *                    false for the one reading them from the decoded instruction
+ */
+CPU::Handler Handler_Of(u16 opcode, bool specialised)
+{
+	return specialised ? dispatch.specialised[opcode] : dispatch.decoded[opcode];
+}
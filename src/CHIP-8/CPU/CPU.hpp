@@ -16,6 +16,8 @@
 
 typedef uint8_t  u8;
 typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
 
 /*
  * CHIP-8 contain 4096 octets of memory
@@ -47,8 +49,37 @@ typedef uint16_t u16;
  */
 #define L 32
 
+/*
+ * Seed of the random generator of Cxkk when none is chosen, runs are reproducible
+ */
+#define DEFAULT_SEED 1
+
+/*
+ * Register of a handler read from the decoded instruction instead of being known at compile time
+ */
+#define DECODED_REGISTER NUMBER_REGISTER
+
 struct CPU
 {
+	/*
+	 * Instruction handler, every opcode is dispatched to one of them
+	 */
+	typedef void (*Handler)(CPU &cpu);
+
+	/*
+	 * Instruction decoded once, handler and operands are ready to be executed
+	 */
+	struct Decoded
+	{
+		Handler handler;
+		u16     opcode;
+		u16     nnn;
+		u8      x;
+		u8      y;
+		u8      kk;
+		u8      n;
+	};
+
 	/*
 	 * List of registers Vx which can be (V0,V1,V2 .... VF)
 	 */
@@ -77,9 +108,9 @@ struct CPU
 	u8 key[NUMBER_REGISTER];
 	
 	/*
-	 * Graphic buffer
+	 * Graphic buffer, one row of 64 pixels per word, bit 63 is the left pixel
 	 */
-	u8 gfx[l*L];
+	u64 gfx[L];
 	
 	/*
 	 * Index of register to store memory adress
@@ -101,43 +132,181 @@ struct CPU
 	 */
 	u16 opcode;
 
+	/*
+	 * Rows of gfx drawn since the screen was presented, bit n for row n
+	 */
+	u32 dirty;
+
+	/*
+	 * Lowest and highest adresses written by Fx33 and Fx55 since they were reset,
+	 * written_low is above written_high when nothing was written
+	 */
+	u16 written_low;
+	u16 written_high;
+
+	/*
+	 * State of the xorshift generator used by Cxkk, never zero,
+	 * seeded with DEFAULT_SEED by the constructor
+	 */
+	u32 rng;
+
+	/*
+	 * Set when an invalid opcode is executed, pc is left on the faulting instruction
+	 */
+	bool fault;
+
+	/*
+	 * Adress and opcode of the instruction which faulted, set with fault
+	 */
+	u16 fault_pc;
+	u16 fault_opcode;
+
+	/*
+	 * Set by Fx0A when no key is pressed, the engine stops and the rest of its cycles are spent waiting
+	 */
+	bool waiting;
+
+	/*
+	 * Decoded instruction of each even adress of memory, handler is null when it must be decoded again
+	 */
+	Decoded cache[MEMORY_SIZE / 2];
+
+	/*
+	 * Decoded instruction of an odd adress or outside memory, they are never cached
+	 */
+	Decoded scratch;
+
+	/*
+	 * Instruction being executed, handlers read their operands from it
+	 */
+	const Decoded *ins;
+
 	CPU(void);
+
+	/**
+	 * @brief Forget the decoded instruction which contain an adress after memory has been written
+	 */
+	void invalidate(unsigned adress){
+		cache[(adress & (MEMORY_SIZE - 1)) >> 1].handler = nullptr;
+	}
+
+	/**
+	 * @brief Forget every decoded instruction
+	 * @see   CPU.cpp
+	 */
+	void invalidate(void);
+
+	/**
+	 * @brief Extend the range of written adresses
+	 */
+	void wrote(unsigned adress, unsigned length){
+		const unsigned first = adress & (MEMORY_SIZE - 1);
+		const unsigned last  = first + length - 1;
+
+		// Wrapping around memory, both ends were written
+		if (last >= MEMORY_SIZE)
+		{
+			written_low  = 0;
+			written_high = MEMORY_SIZE - 1;
+			return;
+		}
+		if (first < written_low)  written_low  = first;
+		if (last > written_high)  written_high = last;
+	}
+
+	/**
+	 * @brief XOR a sprite onto the screen
+	 * @see   CPU.cpp
+	 * @return 1 when a lit pixel was erased, 0 otherwise
+	 */
+	u8 draw(u8 column, u8 row, u16 adress, unsigned height);
+
+	/**
+	 * @brief Fault on an instruction, pc is left on it
+	 * @param adress adress of the instruction
+	 * @param faulting its opcode, reported when the emulation stops
+	 */
+	void raise_fault(u16 adress, u16 faulting){
+		fault        = true;
+		pc           = adress;
+		fault_pc     = adress;
+		fault_opcode = faulting;
+	}
+
+	/**
+	 * @brief Opcode at an adress, as the engines fetch it
+	 */
+	u16 fetch(unsigned adress) const {
+		return memory[adress & (MEMORY_SIZE - 1)] << 8 | memory[(adress + 1) & (MEMORY_SIZE - 1)];
+	}
+
+	/**
+	 * @brief Restart the random generator of Cxkk from a seed
+	 */
+	void seed(u32 value){
+		// Zero would stay zero forever
+		rng = value ? value : 0x9E3779B9;
+	}
+
+	/**
+	 * @brief Next random byte, each instance has its own generator
+	 */
+	u8 random(void){
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return rng >> 24;
+	}
+
+	/**
+	 * @brief Pixel of the screen, 1 when lit
+	 */
+	u8 pixel(unsigned column, unsigned row) const {
+		return (gfx[row] >> (l - 1 - column)) & 1;
+	}
 	
-	/* List of instructions */
+	/* List of instructions, those naming registers are specialised on them unless they are DECODED_REGISTER */
 	void OP_00E0(void);
 	void OP_00EE(void);
 	void OP_1nnn(void);
 	void OP_2nnn(void);
-	void OP_3xkk(void);
-	void OP_4xkk(void);
-	void OP_5xy0(void);
-	void OP_6xkk(void);
-	void OP_7xkk(void);
-	void OP_8xy0(void);
-	void OP_8xy1(void);
-	void OP_8xy2(void);
-	void OP_8xy3(void);
-	void OP_8xy4(void);
-	void OP_8xy5(void);
-	void OP_8xy6(void);
-	void OP_8xy7(void);
-	void OP_8xyE(void);
-	void OP_9xy0(void);
+	template<unsigned X, unsigned Y> void OP_3xkk(void);
+	template<unsigned X, unsigned Y> void OP_4xkk(void);
+	template<unsigned X, unsigned Y> void OP_5xy0(void);
+	template<unsigned X, unsigned Y> void OP_6xkk(void);
+	template<unsigned X, unsigned Y> void OP_7xkk(void);
+	template<unsigned X, unsigned Y> void OP_8xy0(void);
+	template<unsigned X, unsigned Y> void OP_8xy1(void);
+	template<unsigned X, unsigned Y> void OP_8xy2(void);
+	template<unsigned X, unsigned Y> void OP_8xy3(void);
+	template<unsigned X, unsigned Y> void OP_8xy4(void);
+	template<unsigned X, unsigned Y> void OP_8xy5(void);
+	template<unsigned X, unsigned Y> void OP_8xy6(void);
+	template<unsigned X, unsigned Y> void OP_8xy7(void);
+	template<unsigned X, unsigned Y> void OP_8xyE(void);
+	template<unsigned X, unsigned Y> void OP_9xy0(void);
 	void OP_Annn(void);
 	void OP_Bnnn(void);
-	void OP_Cxkk(void);
-	void OP_Dxyn(void);
-	void OP_Ex9E(void);
-	void OP_ExA1(void);
-	void OP_Fx07(void);
-	void OP_Fx0A(void);
-	void OP_Fx15(void);
-	void OP_Fx18(void);
-	void OP_Fx1E(void);
-	void OP_Fx29(void);
-	void OP_Fx33(void);
-	void OP_Fx55(void);
-	void OP_Fx65(void);
+	template<unsigned X, unsigned Y> void OP_Cxkk(void);
+	template<unsigned X, unsigned Y> void OP_Dxyn(void);
+	template<unsigned X, unsigned Y> void OP_Ex9E(void);
+	template<unsigned X, unsigned Y> void OP_ExA1(void);
+	template<unsigned X, unsigned Y> void OP_Fx07(void);
+	template<unsigned X, unsigned Y> void OP_Fx0A(void);
+	template<unsigned X, unsigned Y> void OP_Fx15(void);
+	template<unsigned X, unsigned Y> void OP_Fx18(void);
+	template<unsigned X, unsigned Y> void OP_Fx1E(void);
+	template<unsigned X, unsigned Y> void OP_Fx29(void);
+	template<unsigned X, unsigned Y> void OP_Fx33(void);
+	template<unsigned X, unsigned Y> void OP_Fx55(void);
+	template<unsigned X, unsigned Y> void OP_Fx65(void);
+	void OP_Invalid(void);
 };
 
+/**
+ * @brief Handler of an opcode
+ * @see   CPU.cpp
+ */
+CPU::Handler Handler_Of(u16 opcode, bool specialised);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+/**
+ * @file  Compress.cpp
+ * @brief Fast LZ77 compression of blocks, used by traces
+ * @details
+ * A block is a list of sequences: a token whose high nibble is the number of literals and
+ * low nibble the length of the match minus COMPRESS_MATCH, the literals, then the offset of
+ * the match on two bytes. A nibble of 15 is continued by bytes added to it until one is
+ * below 255. The last sequence has literals only. Matches are found with a hash table of
+ * the last position of every 4 bytes, which is enough for the repetitive records of traces.
+ * Like LZ4, the search goes faster through bytes which do not compress
+ */
+#include <cstring>
+#include "Compress.hpp"
+
+/*
+ * Shortest match, and bytes hashed to find one
+ */
+#define COMPRESS_MATCH 4
+
+/*
+ * Bits of the hash table of positions
+ */
+#define COMPRESS_HASH_BITS 12
+
+/*
+ * Farthest match, offsets are two bytes
+ */
+#define COMPRESS_WINDOW 0xFFFF
+
+/*
+ * Misses after which the search for a match moves one more byte at a time
+ */
+#define COMPRESS_SKIP 5
+
+/*
+ * The last bytes of a block are always literals, so matches never read past it
+ */
+#define COMPRESS_TAIL 8
+
+/**
+ * @brief Hash of the 4 bytes at data
+ */
+static inline u32 Hash_Match(const u8 *data)
+{
+	u32 value;
+
+	memcpy(&value, data, sizeof(value));
+	return (value * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+/**
+ * @brief Write a length continued after its nibble
+ * @return false when out is too small
+ */
+static inline bool Write_Length(u8 *&at, const u8 *end, unsigned long length)
+{
+	for(; length >= 255; length -= 255)
+	{
+		if (at == end)
+			return false;
+		*at++ = 255;
+	}
+	if (at == end)
+		return false;
+	*at++ = (u8)length;
+	return true;
+}
+
+/**
+ * @brief Write a sequence of literals followed by a match, or literals alone when length is 0
+ * @return false when out is too small
+ */
+static bool Write_Sequence(u8 *&at, const u8 *end, const u8 *literals, unsigned long count, unsigned long offset, unsigned long length)
+{
+	if (at == end)
+		return false;
+
+	u8 *token = at++;
+	*token = (u8)((count < 15 ? count : 15) << 4);
+	if (count >= 15 && !Write_Length(at, end, count - 15))
+		return false;
+
+	if ((unsigned long)(end - at) < count)
+		return false;
+	memcpy(at, literals, count);
+	at += count;
+
+	if (!length)
+		return true;
+
+	if (end - at < 2)
+		return false;
+	*at++ = offset & 0xFF;
+	*at++ = offset >> 8;
+
+	length -= COMPRESS_MATCH;
+	*token |= (u8)(length < 15 ? length : 15);
+	return length < 15 || Write_Length(at, end, length - 15);
+}
+
+/**
+ * @brief Compress a block
+ * @param in       bytes to compress
+ * @param size     number of bytes
+ * @param out      receives the compressed block, COMPRESS_BOUND(size) bytes are always enough
+ * @param capacity size of out
+ * @return size of the compressed block, 0 when out is too small
+ */
+unsigned long Compress(const u8 *in, unsigned long size, u8 *out, unsigned long capacity)
+{
+	u32 last[1 << COMPRESS_HASH_BITS];
+	u8 *at = out;
+	const u8 *end = out + capacity;
+
+	memset(last, 0xFF, sizeof(last));
+
+	unsigned long anchor = 0;
+	unsigned long i      = 0;
+	unsigned long misses = 0;
+
+	while (size > COMPRESS_TAIL + COMPRESS_MATCH && i < size - COMPRESS_TAIL - COMPRESS_MATCH)
+	{
+		const u32 hash      = Hash_Match(in + i);
+		const u32 candidate = last[hash];
+		last[hash] = (u32)i;
+
+		// Bytes which do not repeat are skipped faster and faster
+		if (candidate == 0xFFFFFFFFu || i - candidate > COMPRESS_WINDOW || memcmp(in + candidate, in + i, COMPRESS_MATCH) != 0)
+		{
+			i += 1 + (misses++ >> COMPRESS_SKIP);
+			continue;
+		}
+		misses = 0;
+
+		unsigned long length = COMPRESS_MATCH;
+		while (i + length < size - COMPRESS_TAIL && in[candidate + length] == in[i + length]){
+			++length;
+		}
+
+		if (!Write_Sequence(at, end, in + anchor, i - anchor, i - candidate, length))
+			return 0;
+
+		i     += length;
+		anchor = i;
+	}
+
+	if (!Write_Sequence(at, end, in + anchor, size - anchor, 0, 0))
+		return 0;
+	return at - out;
+}
+
+/**
+ * @brief Read a length continued after its nibble
+ * @return false when the block ends first
+ */
+static inline bool Read_Length(const u8 *&at, const u8 *end, unsigned long &length)
+{
+	u8 next;
+
+	do
+	{
+		if (at == end)
+			return false;
+		next    = *at++;
+		length += next;
+	} while (next == 255);
+	return true;
+}
+
+/**
+ * @brief Decompress a block written by Compress
+ * @param in     compressed block
+ * @param packed size of the compressed block
+ * @param out    receives the bytes
+ * @param size   number of bytes the block gives
+ * @return false when the block is damaged or does not give exactly size bytes
+ */
+bool Decompress(const u8 *in, unsigned long packed, u8 *out, unsigned long size)
+{
+	const u8 *at  = in;
+	const u8 *end = in + packed;
+	unsigned long done = 0;
+
+	while (at < end)
+	{
+		const u8 token = *at++;
+
+		unsigned long count = token >> 4;
+		if (count == 15 && !Read_Length(at, end, count))
+			return false;
+		if ((unsigned long)(end - at) < count || size - done < count)
+			return false;
+
+		memcpy(out + done, at, count);
+		at   += count;
+		done += count;
+
+		// The last sequence has no match
+		if (at == end)
+			break;
+
+		if (end - at < 2)
+			return false;
+		const unsigned long offset = at[0] | at[1] << 8;
+		at += 2;
+
+		unsigned long length = token & 0x0F;
+		if (length == 15 && !Read_Length(at, end, length))
+			return false;
+		length += COMPRESS_MATCH;
+
+		if (offset == 0 || offset > done || size - done < length)
+			return false;
+
+		// Matches may overlap what they write, bytes are copied one by one
+		for(unsigned long k = 0; k < length; ++k, ++done){
+			out[done] = out[done - offset];
+		}
+	}
+	return done == size;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file Compress.hpp
+ * @brief Fast LZ77 compression of blocks, used by traces
+ * @see Compress.cpp
+ */
+#ifndef COMPRESS_HPP
+#define COMPRESS_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Room needed by Compress for size bytes, when nothing repeats at all
+ */
+#define COMPRESS_BOUND(size) ((size) + (size) / 255 + 16)
+
+/**
+ * @brief Compress a block
+ * @see   Compress.cpp
+ * @return size of the compressed block, 0 when out is too small
+ */
+unsigned long Compress(const u8 *in, unsigned long size, u8 *out, unsigned long capacity);
+
+/**
+ * @brief Decompress a block written by Compress
+ * @see   Compress.cpp
+ * @return false when the block is damaged or does not give exactly size bytes
+ */
+bool Decompress(const u8 *in, unsigned long packed, u8 *out, unsigned long size);
+
+#endif
@@ -0,0 +1,209 @@
+/**
+ * @file Delta.hpp
+ * @brief Runs of bytes which differ between two buffers, used by save states and rewind
+ * @details
+ * A delta is a list of runs: a count of unchanged bytes, a count of changed bytes then the
+ * changed bytes XORed with the base, counts being LEB128. A run of no changed byte ends the
+ * list. Applying a delta XORs it again, so the same delta goes from base to data and back
+ */
+#ifndef DELTA_HPP
+#define DELTA_HPP
+#include <cstring>
+#include "CPU/CPU.hpp"
+
+/*
+ * Unchanged bytes which end a run of changed bytes, fewer cost less inside the run
+ */
+#define DELTA_GAP 3
+
+/*
+ * Bytes written into a buffer, writing stops at the end of the buffer
+ */
+struct Byte_Writer
+{
+	u8       *at;
+	u8 *const end;
+	bool      ok;
+
+	void byte(u8 value){
+		if (at == end){
+			ok = false;
+			return;
+		}
+		*at++ = value;
+	}
+
+	u8 *reserve(unsigned long size){
+		if ((unsigned long)(end - at) < size){
+			ok = false;
+			return nullptr;
+		}
+		u8 *reserved = at;
+		at += size;
+		return reserved;
+	}
+
+	void word(u16 value){
+		byte(value & 0xFF);
+		byte(value >> 8);
+	}
+
+	void dword(u32 value){
+		word(value & 0xFFFF);
+		word(value >> 16);
+	}
+
+	void count(unsigned value){
+		while (value >= 0x80)
+		{
+			byte((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		byte(value);
+	}
+};
+
+/*
+ * Bytes read from a buffer, reading past its end fails
+ */
+struct Byte_Reader
+{
+	const u8       *at;
+	const u8 *const end;
+	bool            ok;
+
+	u8 byte(void){
+		if (at == end){
+			ok = false;
+			return 0;
+		}
+		return *at++;
+	}
+
+	u16 word(void){
+		u16 low = byte();
+		return low | byte() << 8;
+	}
+
+	u32 dword(void){
+		u32 low = word();
+		return low | (u32)word() << 16;
+	}
+
+	unsigned count(void){
+		unsigned value = 0;
+		for(unsigned shift = 0; shift < 21; shift += 7)
+		{
+			u8 next = byte();
+			value |= (unsigned)(next & 0x7F) << shift;
+			if (!(next & 0x80))
+				return value;
+		}
+		ok = false;
+		return 0;
+	}
+};
+
+/**
+ * @brief Write the runs of bytes of data which differ from base
+ * @details Equal bytes are skipped 32 at a time, the usual case
+ */
+inline void Write_Delta(Byte_Writer &out, const u8 *data, const u8 *base, unsigned size)
+{
+	unsigned i = 0;
+
+	for(;;)
+	{
+		const unsigned start = i;
+
+		while (i + 32 <= size)
+		{
+			u64 a[4], b[4];
+			memcpy(a, data + i, 32);
+			memcpy(b, base + i, 32);
+			if ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3]))
+				break;
+			i += 32;
+		}
+		while (i < size && data[i] == base[i]){
+			++i;
+		}
+		if (i == size)
+			break;
+
+		// Changed bytes until DELTA_GAP equal ones or the end
+		const unsigned first = i;
+		unsigned last = i;
+		while (i < size)
+		{
+			if (data[i] != base[i])
+				last = ++i;
+			else if (i - last + 1 >= DELTA_GAP)
+				break;
+			else
+				++i;
+		}
+		i = last;
+
+		out.count(first - start);
+		out.count(last - first);
+
+		u8 *to = out.reserve(last - first);
+		if (!to)
+			return;
+		for(unsigned k = first; k < last; ++k){
+			*to++ = data[k] ^ base[k];
+		}
+	}
+	out.count(0);
+	out.count(0);
+}
+
+/**
+ * @brief Go over runs written by Write_Delta without applying them
+ * @return false when a run goes past size or past the buffer
+ */
+inline bool Check_Delta(Byte_Reader &in, unsigned size)
+{
+	unsigned i = 0;
+
+	for(;;)
+	{
+		const unsigned skip    = in.count();
+		const unsigned changed = in.count();
+
+		if (!in.ok)
+			return false;
+		if (changed == 0)
+			return true;
+		if (skip > size - i || changed > size - i - skip || (unsigned long)(in.end - in.at) < changed)
+			return false;
+
+		in.at += changed;
+		i     += skip + changed;
+	}
+}
+
+/**
+ * @brief XOR runs already checked by Check_Delta into data
+ */
+inline void Apply_Delta(Byte_Reader in, u8 *data)
+{
+	unsigned i = 0;
+
+	for(;;)
+	{
+		const unsigned skip    = in.count();
+		const unsigned changed = in.count();
+
+		if (changed == 0)
+			return;
+
+		i += skip;
+		for(unsigned k = 0; k < changed; ++k){
+			data[i++] ^= *in.at++;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * @file  Disassembler.cpp
+ * @brief Names and classes of opcodes, for reports of the benchmark and the profiler
+ * @details Mnemonics are the ones of Cowgod's technical reference, invalid opcodes are written as data
+ */
+#include <cstdio>
+#include "Disassembler.hpp"
+
+/*
+ * Names of classes indexed by Opcode_Class
+ */
+static constexpr const char *class_names[NUMBER_CLASS] =
+{
+	"flow", "skip", "load", "alu", "random", "display", "input", "timer", "memory", "invalid"
+};
+
+/*
+ * Mnemonics of the arithmetic group indexed by the low nibble, null when invalid
+ */
+static constexpr const char *alu_names[16] =
+{
+	"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+	nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+};
+
+/**
+ * @brief Class of an opcode
+ */
+Opcode_Class Classify_Opcode(u16 opcode)
+{
+	u8 kk = opcode & 0x00FF;
+
+	switch (opcode >> 12)
+	{
+		case 0x0:
+			if ((opcode & 0xF) == 0x0) return CLASS_DISPLAY;
+			if ((opcode & 0xF) == 0xE) return CLASS_FLOW;
+			return CLASS_INVALID;
+		case 0x1: case 0x2: case 0xB:
+			return CLASS_FLOW;
+		case 0x3: case 0x4: case 0x5: case 0x9:
+			return CLASS_SKIP;
+		case 0x6: case 0xA:
+			return CLASS_LOAD;
+		case 0x7:
+			return CLASS_ALU;
+		case 0x8:
+			switch (opcode & 0xF)
+			{
+				case 0x0: return CLASS_LOAD;
+				case 0x1: case 0x2: case 0x3: case 0x4:
+				case 0x5: case 0x6: case 0x7: case 0xE: return CLASS_ALU;
+				default: return CLASS_INVALID;
+			}
+		case 0xC:
+			return CLASS_RANDOM;
+		case 0xD:
+			return CLASS_DISPLAY;
+		case 0xE:
+			return (kk == 0x9E || kk == 0xA1) ? CLASS_INPUT : CLASS_INVALID;
+		default:
+			switch (kk)
+			{
+				case 0x07: case 0x15: case 0x18: return CLASS_TIMER;
+				case 0x0A: return CLASS_INPUT;
+				case 0x1E: case 0x29: return CLASS_ALU;
+				case 0x33: case 0x55: case 0x65: return CLASS_MEMORY;
+				default: return CLASS_INVALID;
+			}
+	}
+}
+
+/**
+ * @brief Name of a class, as printed in reports
+ */
+const char *Class_Name(Opcode_Class opcode_class)
+{
+	return class_names[opcode_class];
+}
+
+/**
+ * @brief Whether the instruction after an opcode may not be the next one executed
+ * @details Jumps, calls, returns, skips, Fx0A which waits and invalid opcodes which fault
+ */
+bool Ends_Block(u16 opcode)
+{
+	switch (Classify_Opcode(opcode))
+	{
+		case CLASS_FLOW:
+		case CLASS_SKIP:
+		case CLASS_INPUT:
+		case CLASS_INVALID:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * @brief Write the assembly of an opcode, such as "LD V1, 0x20"
+ * @param opcode opcode to write
+ * @param text   receives the text, DISASSEMBLY_SIZE bytes at most
+ */
+void Disassemble(u16 opcode, char text[DISASSEMBLY_SIZE])
+{
+	const unsigned x   = (opcode & 0x0F00) >> 8;
+	const unsigned y   = (opcode & 0x00F0) >> 4;
+	const unsigned n   = opcode & 0x000F;
+	const unsigned kk  = opcode & 0x00FF;
+	const unsigned nnn = opcode & 0x0FFF;
+
+	switch (Classify_Opcode(opcode) == CLASS_INVALID ? 0x10 : opcode >> 12)
+	{
+		case 0x0:
+			snprintf(text, DISASSEMBLY_SIZE, n == 0x0 ? "CLS" : "RET");
+			break;
+		case 0x1: snprintf(text, DISASSEMBLY_SIZE, "JP 0x%.3X", nnn);                 break;
+		case 0x2: snprintf(text, DISASSEMBLY_SIZE, "CALL 0x%.3X", nnn);               break;
+		case 0x3: snprintf(text, DISASSEMBLY_SIZE, "SE V%X, 0x%.2X", x, kk);          break;
+		case 0x4: snprintf(text, DISASSEMBLY_SIZE, "SNE V%X, 0x%.2X", x, kk);         break;
+		case 0x5: snprintf(text, DISASSEMBLY_SIZE, "SE V%X, V%X", x, y);              break;
+		case 0x6: snprintf(text, DISASSEMBLY_SIZE, "LD V%X, 0x%.2X", x, kk);          break;
+		case 0x7: snprintf(text, DISASSEMBLY_SIZE, "ADD V%X, 0x%.2X", x, kk);         break;
+		case 0x8: snprintf(text, DISASSEMBLY_SIZE, "%s V%X, V%X", alu_names[n], x, y); break;
+		case 0x9: snprintf(text, DISASSEMBLY_SIZE, "SNE V%X, V%X", x, y);             break;
+		case 0xA: snprintf(text, DISASSEMBLY_SIZE, "LD I, 0x%.3X", nnn);              break;
+		case 0xB: snprintf(text, DISASSEMBLY_SIZE, "JP V0, 0x%.3X", nnn);             break;
+		case 0xC: snprintf(text, DISASSEMBLY_SIZE, "RND V%X, 0x%.2X", x, kk);         break;
+		case 0xD: snprintf(text, DISASSEMBLY_SIZE, "DRW V%X, V%X, %u", x, y, n);      break;
+		case 0xE: snprintf(text, DISASSEMBLY_SIZE, kk == 0x9E ? "SKP V%X" : "SKNP V%X", x); break;
+		case 0xF:
+			switch (kk)
+			{
+				case 0x07: snprintf(text, DISASSEMBLY_SIZE, "LD V%X, DT", x);  break;
+				case 0x0A: snprintf(text, DISASSEMBLY_SIZE, "LD V%X, K", x);   break;
+				case 0x15: snprintf(text, DISASSEMBLY_SIZE, "LD DT, V%X", x);  break;
+				case 0x18: snprintf(text, DISASSEMBLY_SIZE, "LD ST, V%X", x);  break;
+				case 0x1E: snprintf(text, DISASSEMBLY_SIZE, "ADD I, V%X", x);  break;
+				case 0x29: snprintf(text, DISASSEMBLY_SIZE, "LD F, V%X", x);   break;
+				case 0x33: snprintf(text, DISASSEMBLY_SIZE, "LD B, V%X", x);   break;
+				case 0x55: snprintf(text, DISASSEMBLY_SIZE, "LD [I], V%X", x); break;
+				default:   snprintf(text, DISASSEMBLY_SIZE, "LD V%X, [I]", x); break;
+			}
+			break;
+		default:
+			snprintf(text, DISASSEMBLY_SIZE, "DW 0x%.4X", opcode);
+			break;
+	}
+}
@@ -0,0 +1,57 @@
+/**
+ * @file Disassembler.hpp
+ * @brief Names and classes of opcodes, for reports of the benchmark and the profiler
+ * @see Disassembler.cpp
+ */
+#ifndef DISASSEMBLER_HPP
+#define DISASSEMBLER_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Longest text written by Disassemble, terminator included
+ */
+#define DISASSEMBLY_SIZE 24
+
+/*
+ * Classes of opcodes
+ */
+enum Opcode_Class
+{
+	CLASS_FLOW,    /* 00EE, 1nnn, 2nnn, Bnnn */
+	CLASS_SKIP,    /* 3xkk, 4xkk, 5xy0, 9xy0 */
+	CLASS_LOAD,    /* 6xkk, 8xy0, Annn */
+	CLASS_ALU,     /* 7xkk, 8xy1 to 8xyE, Fx1E, Fx29 */
+	CLASS_RANDOM,  /* Cxkk */
+	CLASS_DISPLAY, /* 00E0, Dxyn */
+	CLASS_INPUT,   /* Ex9E, ExA1, Fx0A */
+	CLASS_TIMER,   /* Fx07, Fx15, Fx18 */
+	CLASS_MEMORY,  /* Fx33, Fx55, Fx65 */
+	CLASS_INVALID,
+	NUMBER_CLASS
+};
+
+/**
+ * @brief Class of an opcode
+ * @see   Disassembler.cpp
+ */
+Opcode_Class Classify_Opcode(u16 opcode);
+
+/**
+ * @brief Name of a class, as printed in reports
+ * @see   Disassembler.cpp
+ */
+const char *Class_Name(Opcode_Class opcode_class);
+
+/**
+ * @brief Whether the instruction after an opcode may not be the next one executed
+ * @see   Disassembler.cpp
+ */
+bool Ends_Block(u16 opcode);
+
+/**
+ * @brief Write the assembly of an opcode, such as "LD V1, 0x20"
+ * @see   Disassembler.cpp
+ */
+void Disassemble(u16 opcode, char text[DISASSEMBLY_SIZE]);
+
+#endif
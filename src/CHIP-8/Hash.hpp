@@ -0,0 +1,38 @@
+/**
+ * @file Hash.hpp
+ * @brief FNV-1a hash of memory, used to compare states between runs
+ */
+#ifndef HASH_HPP
+#define HASH_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Starting value of a 64 bits FNV-1a hash
+ */
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+
+/*
+ * Multiplier of a 64 bits FNV-1a hash
+ */
+#define FNV_PRIME 0x00000100000001B3ULL
+
+/**
+ * @brief Hash bytes, a previous hash can be given to chain several buffers
+ * @param data bytes to hash
+ * @param size number of bytes
+ * @param hash starting value
+ * @return 64 bits FNV-1a hash
+ */
+inline u64 Hash(const void *data, unsigned long size, u64 hash = FNV_OFFSET)
+{
+	const u8 *bytes = static_cast<const u8*>(data);
+
+	for(unsigned long i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+#endif
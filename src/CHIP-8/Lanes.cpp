@@ -0,0 +1,629 @@
+/**
+ * @file  Lanes.cpp
+ * @brief Instances of one rom executed in lockstep, registers laid out per lane
+ * @details
+ * A frame starting with every lane at the same adress runs in lockstep: an instruction is
+ * executed once for all of them, register instructions become vector operations and the ones
+ * touching keys, the stack, the screen or reading memory loop over lanes. Instructions writing
+ * memory and invalid ones are executed lane by lane by the engine of each machine, so semantics
+ * are the ones of CPU.cpp. Once lanes are at different adresses, or wait for a key, each one
+ * finishes the frame alone.
+ *
+ * When every lane comes back to the adress the frame started at with the registers it had
+ * there, having changed nothing else, the next iterations would do the same until timers or
+ * keys change: they are skipped like CHIP_8::skip_idle does, every lane at once. Frames starting
+ * apart run lane by lane with CHIP_8::run_frame, so do frames starting on Fx0A or with every
+ * lane settled, which CHIP_8::run_frame skips. Every lane ends where its machine alone would,
+ * with the same count of instructions, faulted lanes are left out
+ */
+#include <cstring>
+#include "Lanes.hpp"
+
+/*
+ * Results of Lanes::vector_step other than the adress every lane went to
+ */
+#define LANES_APART  -1  /* Executed, lanes are at different adresses, as converged returns */
+#define LANES_ALONE  -2  /* Not executed, every lane finishes the frame alone */
+#define LANES_SINGLE -3  /* Not executed, every lane executes it alone */
+
+/**
+ * @brief No lane is loaded yet
+ */
+Lanes::Lanes(void)
+{
+	active           = 0;
+	loose            = 0;
+	changed          = false;
+	cycles_per_frame = CYCLES_PER_FRAME;
+	vector_frames    = 0;
+	lane_frames      = 0;
+
+	memset(divergent, 0, sizeof(divergent));
+	memset(frames, 0, sizeof(frames));
+	memset(cycles, 0, sizeof(cycles));
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		live[lane] = 0;
+		fetch(lane);
+	}
+}
+
+/**
+ * @brief Load the same rom in the first lanes, the others are left out
+ * @details Machines must not have run yet, like CHIP_8::load they keep their registers
+ * @param rom   read by Rom_Load
+ * @param count lanes to load, LANES at most
+ */
+void Lanes::load(const Rom &rom, unsigned count)
+{
+	active = 0;
+	loose  = 0;
+	memset(divergent, 0, sizeof(divergent));
+
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		machine[lane].load(rom);
+		if (lane < count){
+			active |= 1u << lane;
+		}
+		live[lane] = lane < count ? 0xFF : 0;
+		fetch(lane);
+	}
+}
+
+/**
+ * @brief Machine of a lane with its registers up to date
+ * @details A faulted lane kept the registers it had when it faulted
+ */
+CHIP_8 &Lanes::lane(unsigned n)
+{
+	if ((active & ~loose) >> n & 1){
+		store(n);
+	}
+	return machine[n];
+}
+
+/**
+ * @brief Copy registers of the machine of a lane into the lanes
+ */
+void Lanes::fetch(unsigned lane)
+{
+	const CPU &cpu = machine[lane].cpu;
+
+	for(unsigned r = 0; r < NUMBER_REGISTER; ++r){
+		V[r][lane] = cpu.V[r];
+	}
+	I[lane]           = cpu.I;
+	pc[lane]          = cpu.pc;
+	delay_timer[lane] = cpu.delay_timer;
+	sound_timer[lane] = cpu.sound_timer;
+}
+
+/**
+ * @brief Copy registers of a lane into its machine
+ */
+void Lanes::store(unsigned lane)
+{
+	CPU &cpu = machine[lane].cpu;
+
+	for(unsigned r = 0; r < NUMBER_REGISTER; ++r){
+		cpu.V[r] = V[r][lane];
+	}
+	cpu.I           = I[lane];
+	cpu.pc          = pc[lane];
+	cpu.delay_timer = delay_timer[lane];
+	cpu.sound_timer = sound_timer[lane];
+}
+
+/**
+ * @brief Leave out a lane which faulted
+ */
+void Lanes::leave(unsigned lane)
+{
+	active    &= ~(1u << lane);
+	live[lane] = 0;
+}
+
+/**
+ * @brief Adress shared by every active lane
+ * @return the adress, or -1 when lanes are at different adresses
+ */
+int Lanes::converged(void) const
+{
+	int adress = -1;
+
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (!(active >> lane & 1))
+			continue;
+
+		const u16 at = loose >> lane & 1 ? machine[lane].cpu.pc : pc[lane];
+		if (adress < 0)
+			adress = at;
+		else if (adress != at)
+			return -1;
+	}
+	return adress;
+}
+
+/**
+ * @brief Whether a frame starting with every lane at adress runs faster lane by lane
+ * @details Profiled builds always run lane by lane, every instruction is recorded
+ */
+bool Lanes::alone(u16 adress) const
+{
+#ifdef CHIP8_PROFILE
+	(void)adress;
+	return true;
+#else
+	unsigned first = 0;
+	while (!(active >> first & 1)){
+		++first;
+	}
+
+	// Waits for a key are skipped whole
+	if ((machine[first].cpu.fetch(adress) & 0xF0FF) == 0xF00A)
+		return true;
+
+	for(unsigned lane = first; lane < LANES; ++lane)
+	{
+		if ((active >> lane & 1) && !machine[lane].settled)
+			return false;
+	}
+	return true;
+#endif
+}
+
+/**
+ * @brief Every active lane finishes the frame with its own machine
+ * @details
+ * Memory written by Fx33 and Fx55 is marked divergent, the lanes may disagree on it.
+ * Registers stay in the machines until a frame runs in lockstep again
+ * @param done instructions of the frame already executed in lockstep
+ */
+void Lanes::run_alone(unsigned long done)
+{
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (!(active >> lane & 1))
+			continue;
+
+		CHIP_8 &chip8 = machine[lane];
+		CPU &cpu      = chip8.cpu;
+
+		if (!(loose >> lane & 1)){
+			store(lane);
+		}
+		cpu.written_low  = MEMORY_SIZE;
+		cpu.written_high = 0;
+
+		if (done == 0)
+		{
+			chip8.cycles_per_frame = cycles_per_frame;
+			cycles[lane] += chip8.run_frame();
+		}
+		else
+		{
+			cycles[lane] += done + chip8.run(cycles_per_frame - done);
+			chip8.tick_timers();
+		}
+
+		for(unsigned adress = cpu.written_low; adress <= cpu.written_high; ++adress){
+			divergent[adress] = 1;
+		}
+		if (cpu.fault){
+			leave(lane);
+		}
+		loose |= 1u << lane;
+	}
+}
+
+/**
+ * @brief Every active lane executes one instruction with its own machine
+ * @param done instructions of the frame already executed in lockstep
+ */
+void Lanes::run_single(unsigned long done)
+{
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (!(active >> lane & 1))
+			continue;
+
+		CPU &cpu = machine[lane].cpu;
+
+		store(lane);
+		cpu.written_low  = MEMORY_SIZE;
+		cpu.written_high = 0;
+
+		machine[lane].run(1);
+
+		for(unsigned adress = cpu.written_low; adress <= cpu.written_high; ++adress){
+			divergent[adress] = 1;
+		}
+		if (cpu.fault)
+		{
+			cycles[lane] += done + 1;
+			leave(lane);
+		}
+		fetch(lane);
+	}
+}
+
+#ifdef LANES_VECTOR
+/**
+ * @brief Whether two vectors are equal in every lane
+ */
+static bool Same(Lane_Bytes a, Lane_Bytes b)
+{
+	return memcmp(&a, &b, sizeof(a)) == 0;
+}
+#endif
+
+/**
+ * @brief Execute the instruction at adress once for every active lane
+ * @details
+ * The registers of the lanes are read and written, pc is only written when lanes go apart.
+ * changed is set when the stack, the screen or a random generator changed.
+ * Lanes whose memory holds another instruction there run it alone
+ * @return the adress every lane goes to, or LANES_APART, LANES_ALONE or LANES_SINGLE
+ */
+int Lanes::vector_step(u16 adress)
+{
+#ifdef LANES_VECTOR
+	if (adress + 1 >= MEMORY_SIZE)
+		return LANES_SINGLE;
+
+	unsigned first = 0;
+	while (!(active >> first & 1)){
+		++first;
+	}
+
+	const u8 *memory = machine[first].cpu.memory;
+	const u16 opcode = memory[adress] << 8 | memory[adress + 1];
+
+	// Lanes which wrote there may hold another instruction
+	if (divergent[adress] || divergent[adress + 1])
+	{
+		for(unsigned lane = first + 1; lane < LANES; ++lane)
+		{
+			const u8 *other = machine[lane].cpu.memory;
+			if ((active >> lane & 1) && (other[adress] != memory[adress] || other[adress + 1] != memory[adress + 1]))
+				return LANES_SINGLE;
+		}
+	}
+
+	const u16 nnn  = opcode & 0x0FFF;
+	const u8  kk   = opcode & 0x00FF;
+	const u8  x    = (opcode & 0x0F00) >> 8;
+	const u8  y    = (opcode & 0x00F0) >> 4;
+	const u16 next = adress + 2;
+
+	// Lanes skipping the next instruction, 0xFF each
+	Lane_Bytes skip = {};
+
+	switch (opcode & 0xF000)
+	{
+		case 0x0000:
+			// Only the low nibble is decoded, like CPU.cpp does
+			if ((opcode & 0x000F) == 0x0000)
+			{
+				for(unsigned lane = first; lane < LANES; ++lane)
+				{
+					if (active >> lane & 1){
+						machine[lane].cpu.OP_00E0();
+					}
+				}
+				changed = true;
+				return next;
+			}
+			if ((opcode & 0x000F) != 0x000E)
+				return LANES_SINGLE;
+
+			// An empty stack faults
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if ((active >> lane & 1) && machine[lane].cpu.sp == 0)
+					return LANES_SINGLE;
+			}
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if (active >> lane & 1)
+				{
+					CPU &cpu = machine[lane].cpu;
+					cpu.sp--;
+					pc[lane] = cpu.stack[cpu.sp];
+				}
+			}
+			changed = true;
+			return converged();
+
+		case 0x1000:
+			return nnn;
+
+		case 0x2000:
+			// A full stack faults
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if ((active >> lane & 1) && machine[lane].cpu.sp >= NUMBER_REGISTER)
+					return LANES_SINGLE;
+			}
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if (active >> lane & 1)
+				{
+					CPU &cpu = machine[lane].cpu;
+					cpu.stack[cpu.sp] = next;
+					++cpu.sp;
+				}
+			}
+			changed = true;
+			return nnn;
+
+		case 0x3000: skip = (Lane_Bytes)(V[x] == kk);   break;
+		case 0x4000: skip = (Lane_Bytes)(V[x] != kk);   break;
+		case 0x5000: skip = (Lane_Bytes)(V[x] == V[y]); break;
+		case 0x9000: skip = (Lane_Bytes)(V[x] != V[y]); break;
+
+		case 0x6000:
+			V[x] = (Lane_Bytes){} + kk;
+			return next;
+
+		case 0x7000:
+			V[x] += kk;
+			return next;
+
+		case 0x8000:
+			// VF is written before Vx is read again, like CPU.cpp does when x or y is F
+			switch (opcode & 0x000F)
+			{
+				case 0x0: V[x]  = V[y]; break;
+				case 0x1: V[x] |= V[y]; break;
+				case 0x2: V[x] &= V[y]; break;
+				case 0x3: V[x] ^= V[y]; break;
+				case 0x4:
+					V[x]  += V[y];
+					V[0xF] = (Lane_Bytes){};
+					break;
+				case 0x5:
+					V[0xF] = (Lane_Bytes)(V[x] > V[y]) & 1;
+					V[x]  -= V[y];
+					break;
+				case 0x6:
+					V[0xF] = V[x] & 1;
+					V[x] >>= 1;
+					break;
+				case 0x7:
+					V[0xF] = (Lane_Bytes)(V[y] > V[x]) & 1;
+					V[x]   = V[y] - V[x];
+					break;
+				case 0xE:
+					V[0xF] = V[x] >> 7;
+					V[x] <<= 1;
+					break;
+				default:
+					return LANES_SINGLE;
+			}
+			return next;
+
+		case 0xA000:
+			I = (Lane_Words){} + nnn;
+			return next;
+
+		case 0xB000:
+			pc = nnn + __builtin_convertvector(V[0], Lane_Words);
+			return converged();
+
+		case 0xC000:
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if (active >> lane & 1){
+					V[x][lane] = machine[lane].cpu.random() & kk;
+				}
+			}
+			changed = true;
+			return next;
+
+		case 0xD000:
+			// Each machine has its own screen, VF is written last like OP_Dxyn does
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if (active >> lane & 1){
+					V[0xF][lane] = machine[lane].cpu.draw(V[x][lane], V[y][lane], I[lane], opcode & 0x000F);
+				}
+			}
+			changed = true;
+			return next;
+
+		case 0xE000:
+			if (kk != 0x9E && kk != 0xA1)
+				return LANES_SINGLE;
+
+			for(unsigned lane = first; lane < LANES; ++lane)
+			{
+				if (active >> lane & 1){
+					skip[lane] = machine[lane].cpu.key[V[x][lane]] ? 0xFF : 0;
+				}
+			}
+			if (kk == 0xA1){
+				skip = ~skip;
+			}
+			break;
+
+		case 0xF000:
+			switch (kk)
+			{
+				case 0x07: V[x] = delay_timer; break;
+				case 0x15: delay_timer = V[x]; break;
+				case 0x18: sound_timer = V[x]; break;
+				case 0x1E: I += __builtin_convertvector(V[x], Lane_Words); break;
+				case 0x29: I  = __builtin_convertvector(V[x], Lane_Words) * 5; break;
+				case 0x65:
+					for(unsigned lane = first; lane < LANES; ++lane)
+					{
+						if (!(active >> lane & 1))
+							continue;
+
+						const u8 *lane_memory = machine[lane].cpu.memory;
+						for(unsigned r = 0; r <= x; ++r){
+							V[r][lane] = lane_memory[(I[lane] + r) & (MEMORY_SIZE - 1)];
+						}
+					}
+					break;
+
+				// Lanes without a key wait the rest of the frame
+				case 0x0A:
+					return LANES_ALONE;
+
+				// Fx33 and Fx55 write memory, the others fault
+				default:
+					return LANES_SINGLE;
+			}
+			return next;
+	}
+
+	// Skips taken by every lane or by none keep them together
+	skip &= live;
+	if (Same(skip, (Lane_Bytes){}))
+		return next;
+	if (Same(skip, live))
+		return next + 2;
+
+	pc = next + __builtin_convertvector(skip & 2, Lane_Words);
+	return LANES_APART;
+#else
+	(void)adress;
+	return LANES_ALONE;
+#endif
+}
+
+/*
+ * Registers of every lane when they were last at the adress a frame started at, see Lanes::run_frame
+ */
+struct Lane_Registers
+{
+	Lane_Bytes V[NUMBER_REGISTER];
+	Lane_Words I;
+	Lane_Bytes delay_timer;
+	Lane_Bytes sound_timer;
+};
+
+/**
+ * @brief Execute the instructions of a frame then decrease timers in every lane which did not fault
+ * @details
+ * The frame runs in lockstep while lanes stay together, see the top of this file. Lanes left
+ * out still follow register instructions, they can only delay skipping idle loops. A frame run
+ * in lockstep is not seen by CHIP_8::run_frame, the lanes are no longer settled after it
+ */
+void Lanes::run_frame(void)
+{
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (active >> lane & 1){
+			++frames[lane];
+		}
+	}
+
+	const int start = converged();
+	if (start < 0 || alone((u16)start))
+	{
+		++lane_frames;
+		run_alone(0);
+		return;
+	}
+
+	++vector_frames;
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (loose >> lane & 1){
+			fetch(lane);
+		}
+		machine[lane].settled = false;
+	}
+	loose = 0;
+
+	unsigned long done = 0;
+	int  adress   = start;
+	bool together = true;
+
+	// Lanes came back to start after idle_done instructions with these registers
+	Lane_Registers idle;
+	unsigned long  idle_done = 0;
+
+	memcpy(idle.V, V, sizeof(V));
+	memcpy(&idle.I, &I, sizeof(I));
+	memcpy(&idle.delay_timer, &delay_timer, sizeof(delay_timer));
+	memcpy(&idle.sound_timer, &sound_timer, sizeof(sound_timer));
+	changed = false;
+
+	while (done < cycles_per_frame && active && together)
+	{
+		const int next = vector_step((u16)adress);
+
+		if (next >= 0)
+		{
+			adress = next;
+			++done;
+			if (adress != start)
+				continue;
+
+			// Timers and keys do not change during a frame, neither would the next iterations
+			if (!changed && memcmp(idle.V, V, sizeof(V)) == 0 && memcmp(&idle.I, &I, sizeof(I)) == 0 &&
+			    memcmp(&idle.delay_timer, &delay_timer, sizeof(delay_timer)) == 0 &&
+			    memcmp(&idle.sound_timer, &sound_timer, sizeof(sound_timer)) == 0)
+			{
+				const unsigned long length = done - idle_done;
+				done += (cycles_per_frame - done) / length * length;
+			}
+
+			memcpy(idle.V, V, sizeof(V));
+			memcpy(&idle.I, &I, sizeof(I));
+			memcpy(&idle.delay_timer, &delay_timer, sizeof(delay_timer));
+			memcpy(&idle.sound_timer, &sound_timer, sizeof(sound_timer));
+			idle_done = done;
+			changed   = false;
+			continue;
+		}
+		if (next == LANES_APART)
+		{
+			++done;
+			together = false;
+			continue;
+		}
+
+		for(unsigned lane = 0; lane < LANES; ++lane){
+			pc[lane] = (u16)adress;
+		}
+		if (next == LANES_ALONE)
+		{
+			together = false;
+			continue;
+		}
+
+		run_single(done);
+		++done;
+		adress   = converged();
+		together = adress >= 0;
+		changed  = true;
+	}
+
+	if (!active)
+		return;
+
+	if (done < cycles_per_frame)
+	{
+		run_alone(done);
+		return;
+	}
+
+	for(unsigned lane = 0; lane < LANES; ++lane)
+	{
+		if (together){
+			pc[lane] = (u16)adress;
+		}
+		if (active >> lane & 1){
+			cycles[lane] += done;
+		}
+		if (delay_timer[lane] > 0) --delay_timer[lane];
+		if (sound_timer[lane] > 0) --sound_timer[lane];
+	}
+}
@@ -0,0 +1,119 @@
+/**
+ * @file Lanes.hpp
+ * @brief Instances of one rom executed in lockstep, registers laid out per lane
+ * @see Lanes.cpp
+ */
+#ifndef LANES_HPP
+#define LANES_HPP
+#include "CHIP_8.hpp"
+
+/*
+ * Instances executed together, registers are bytes so 16 lanes fill an SSE2 register
+ */
+#define LANES 16
+
+/*
+ * One value per lane, vectors of GCC and Clang, arrays elsewhere
+ */
+#if defined(__GNUC__)
+#define LANES_VECTOR
+typedef u8  Lane_Bytes __attribute__((vector_size(LANES)));
+typedef u16 Lane_Words __attribute__((vector_size(LANES * 2)));
+#else
+typedef u8  Lane_Bytes[LANES];
+typedef u16 Lane_Words[LANES];
+#endif
+
+struct Lanes
+{
+	/*
+	 * Machine of each lane, it holds memory, screen, stack, keys and random generator,
+	 * its registers are only up to date after lane is called.
+	 * Set the engine and the seed of each machine after load
+	 */
+	CHIP_8 machine[LANES];
+
+	/*
+	 * Registers of every lane, V[r][lane]
+	 */
+	Lane_Bytes V[NUMBER_REGISTER];
+	Lane_Words I;
+	Lane_Words pc;
+	Lane_Bytes delay_timer;
+	Lane_Bytes sound_timer;
+
+	/*
+	 * Lanes loaded which did not fault, bit n for lane n, and the same as 0xFF in each lane
+	 */
+	u32        active;
+	Lane_Bytes live;
+
+	/*
+	 * Non zero for each byte of memory written by a lane, lanes may hold different code there
+	 */
+	u8 divergent[MEMORY_SIZE];
+
+	/*
+	 * Instructions executed by run_frame in each lane, CYCLES_PER_FRAME by default
+	 */
+	unsigned long cycles_per_frame;
+
+	/*
+	 * Frames each lane started without having faulted, and the instructions it executed or
+	 * skipped during them, what the sum of CHIP_8::run_frame would be
+	 */
+	unsigned long frames[LANES];
+	unsigned long cycles[LANES];
+
+	/*
+	 * Frames started in lockstep, and lane by lane
+	 */
+	unsigned long vector_frames;
+	unsigned long lane_frames;
+
+	Lanes(void);
+
+	/* Lanes keep the registers of their machines */
+	Lanes(const Lanes&) = delete;
+	Lanes &operator=(const Lanes&) = delete;
+
+	/**
+	 * @brief Load the same rom in the first lanes, the others are left out
+	 * @see   Lanes.cpp
+	 */
+	void load(const Rom &rom, unsigned count);
+
+	/**
+	 * @brief Machine of a lane with its registers up to date
+	 * @see   Lanes.cpp
+	 */
+	CHIP_8 &lane(unsigned n);
+
+	/**
+	 * @brief Execute the instructions of a frame then decrease timers in every lane which did not fault
+	 * @see   Lanes.cpp
+	 */
+	void run_frame(void);
+
+private:
+	/*
+	 * Lanes whose registers are in their machine instead of the lanes, they ran alone last
+	 */
+	u32 loose;
+
+	/*
+	 * Set by vector_step when an instruction changed more than the registers of the lanes
+	 */
+	bool changed;
+
+	void fetch(unsigned lane);
+	void store(unsigned lane);
+	void leave(unsigned lane);
+	int  converged(void) const;
+	bool alone(u16 adress) const;
+	void run_alone(unsigned long done);
+	void run_single(unsigned long done);
+	int  vector_step(u16 adress);
+};
+
+#endif
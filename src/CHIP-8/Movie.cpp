@@ -0,0 +1,376 @@
+/**
+ * @file  Movie.cpp
+ * @brief Keys pressed during a session, replayed frame by frame without window
+ * @details
+ * A session only depends on its rom, the seed of the random generator, the instructions per
+ * frame and the keys pressed before each frame, so a movie keeps the changes of keys and the
+ * frame they happened on, a few bytes each. Every MOVIE_KEYFRAME frames a save state is kept
+ * too, replay starts from the one before the frame asked for instead of the first frame.
+ *
+ * A movie file starts with "C8MV", the version, the id of the image, the seed, the
+ * instructions per frame and the number of frames. The events follow after their size, then
+ * the number of keyframes and each one: its frame, the frame of the event before it, the
+ * offset of its first event, the size of its state then the state. Numbers are little endian
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "Movie.hpp"
+#include "Delta.hpp"
+
+/*
+ * First bytes of every movie
+ */
+static constexpr const u8 movie_magic[4] = { 'C', '8', 'M', 'V' };
+
+/**
+ * @brief Append a LEB128 number to events
+ */
+static void Put_Count(std::vector<u8> &events, u64 value)
+{
+	while (value >= 0x80)
+	{
+		events.push_back((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	events.push_back((u8)value);
+}
+
+/**
+ * @brief Read a LEB128 number of at most 64 bits
+ */
+static u64 Read_Count(Byte_Reader &in)
+{
+	u64 value = 0;
+	for(unsigned shift = 0; shift < 64; shift += 7)
+	{
+		const u8 next = in.byte();
+		value |= (u64)(next & 0x7F) << shift;
+		if (!(next & 0x80))
+			return value;
+	}
+	in.ok = false;
+	return 0;
+}
+
+/**
+ * @brief Write a 64 bits number
+ */
+static void Write_Qword(Byte_Writer &out, u64 value)
+{
+	out.dword((u32)value);
+	out.dword((u32)(value >> 32));
+}
+
+/**
+ * @brief Read a 64 bits number
+ */
+static u64 Read_Qword(Byte_Reader &in)
+{
+	u64 low = in.dword();
+	return low | (u64)in.dword() << 32;
+}
+
+/**
+ * @brief Empty movie, nothing to play until one is started or read
+ */
+Movie::Movie(void)
+{
+	image_id         = 0;
+	seed             = DEFAULT_SEED;
+	cycles_per_frame = CYCLES_PER_FRAME;
+	length           = 0;
+	frame            = 0;
+	event_frame      = 0;
+	event_at         = 0;
+	memset(keys, 0, sizeof(keys));
+}
+
+/**
+ * @brief Start recording a machine which just loaded its rom and seeded its generator
+ * @details Frames recorded before are forgotten
+ * @param chip8 machine to record
+ * @param seed  seed given to its generator
+ */
+void Movie::start(const CHIP_8 &chip8, u32 seed)
+{
+	image_id         = chip8.image_id;
+	this->seed       = seed;
+	cycles_per_frame = (u32)chip8.cycles_per_frame;
+	length           = 0;
+
+	events.clear();
+	keyframes.clear();
+	states.clear();
+
+	frame       = 0;
+	event_frame = 0;
+	event_at    = 0;
+	memset(keys, 0, sizeof(keys));
+}
+
+/**
+ * @brief Record the keys of the frame about to run
+ * @details
+ * Called once per frame after events were handled and before CHIP_8::run_frame. Keys are
+ * compared with the previous frame, a key pressed then released between two frames was
+ * never seen by the program and is not recorded either
+ * @param chip8 machine about to run a frame
+ */
+void Movie::record(const CHIP_8 &chip8)
+{
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i)
+	{
+		const u8 pressed = chip8.cpu.key[i] != 0;
+		if (pressed == keys[i])
+			continue;
+
+		Put_Count(events, frame - event_frame);
+		events.push_back((u8)(i | (pressed ? MOVIE_PRESSED : 0)));
+		event_frame = frame;
+		keys[i]     = pressed;
+	}
+
+	if (frame % MOVIE_KEYFRAME == 0)
+	{
+		u8 state[STATE_MAX_SIZE];
+		const unsigned long size = chip8.save(state, sizeof(state));
+
+		Movie_Keyframe keyframe = { frame, event_frame, (unsigned long)events.size(), (unsigned long)states.size(), size };
+		keyframes.push_back(keyframe);
+		states.insert(states.end(), state, state + size);
+	}
+
+	length = ++frame;
+}
+
+/**
+ * @brief Write the movie into a file
+ * @param file_path file to create, replaced when it exists
+ * @return false when the file can not be written
+ */
+bool Movie::write(const char *file_path) const
+{
+	std::vector<u8> buffer(64 + events.size() + keyframes.size() * 24 + states.size());
+	Byte_Writer out = { buffer.data(), buffer.data() + buffer.size(), true };
+
+	for(u8 byte : movie_magic){
+		out.byte(byte);
+	}
+	out.byte(MOVIE_VERSION);
+	out.dword(image_id);
+	out.dword(seed);
+	out.dword(cycles_per_frame);
+	Write_Qword(out, length);
+
+	out.dword((u32)events.size());
+	u8 *to = out.reserve(events.size());
+	if (to && !events.empty()){
+		memcpy(to, events.data(), events.size());
+	}
+
+	out.dword((u32)keyframes.size());
+	for(const Movie_Keyframe &keyframe : keyframes)
+	{
+		Write_Qword(out, keyframe.frame);
+		Write_Qword(out, keyframe.event_frame);
+		out.dword((u32)keyframe.event_offset);
+		out.dword((u32)keyframe.state_size);
+
+		to = out.reserve(keyframe.state_size);
+		if (to){
+			memcpy(to, states.data() + keyframe.state_offset, keyframe.state_size);
+		}
+	}
+
+	FILE *file = fopen(file_path, "wb");
+	if (!file || !out.ok)
+	{
+		std::cerr << "Failed to write the movie " << file_path << std::endl;
+		if (file){
+			fclose(file);
+		}
+		return false;
+	}
+
+	const unsigned long size = out.at - buffer.data();
+	const bool written = fwrite(buffer.data(), 1, size, file) == size;
+	if (fclose(file) != 0 || !written)
+	{
+		std::cerr << "Failed to write the movie " << file_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Read a movie written by write
+ * @details
+ * Every event and keyframe is checked, keyframes must start at frame 0, follow each other
+ * and point to the first event of a frame. The movie is positioned on its first frame
+ * @param file_path movie file
+ * @return false when the file can not be read or is not a valid movie, the movie is then empty
+ */
+bool Movie::read(const char *file_path)
+{
+	FILE *file = fopen(file_path, "rb");
+	if (!file)
+	{
+		std::cerr << "Failed to open the movie " << file_path << std::endl;
+		return false;
+	}
+
+	std::vector<u8> buffer;
+	u8 chunk[1 << 16];
+	for(size_t got; (got = fread(chunk, 1, sizeof(chunk), file)) > 0; ){
+		buffer.insert(buffer.end(), chunk, chunk + got);
+	}
+	fclose(file);
+
+	Byte_Reader in = { buffer.data(), buffer.data() + buffer.size(), true };
+	bool valid = true;
+
+	for(u8 byte : movie_magic){
+		valid &= in.byte() == byte;
+	}
+	valid &= in.byte() == MOVIE_VERSION;
+
+	image_id         = in.dword();
+	seed             = in.dword();
+	cycles_per_frame = in.dword();
+	length           = Read_Qword(in);
+
+	const u32 event_size = in.dword();
+	valid &= in.ok && cycles_per_frame > 0 && (unsigned long)(in.end - in.at) >= event_size;
+	events.assign(in.at, valid ? in.at + event_size : in.at);
+	in.at += events.size();
+
+	// Offsets where an event starts, and the frame of the event before each one
+	std::vector<unsigned long> starts;
+	std::vector<u64>           frames;
+	{
+		Byte_Reader list = { events.data(), events.data() + events.size(), true };
+		u64 at_frame = 0;
+
+		while (valid && list.at != list.end)
+		{
+			starts.push_back(list.at - events.data());
+			frames.push_back(at_frame);
+
+			at_frame += Read_Count(list);
+			valid &= list.byte() < 2 * MOVIE_PRESSED && list.ok && at_frame < length;
+		}
+		starts.push_back(events.size());
+		frames.push_back(at_frame);
+	}
+
+	const u32 count = in.dword();
+	keyframes.clear();
+	states.clear();
+
+	for(u32 i = 0; valid && i < count; ++i)
+	{
+		Movie_Keyframe keyframe;
+		keyframe.frame        = Read_Qword(in);
+		keyframe.event_frame  = Read_Qword(in);
+		keyframe.event_offset = in.dword();
+		keyframe.state_size   = in.dword();
+		keyframe.state_offset = states.size();
+
+		const u64 previous = i == 0 ? 0 : keyframes.back().frame;
+		valid &= in.ok && keyframe.frame <= length && (i == 0 ? keyframe.frame == 0 : keyframe.frame > previous);
+
+		// The event must start a frame after the keyframe, the ones before must be at most at it
+		const auto start = std::lower_bound(starts.begin(), starts.end(), keyframe.event_offset);
+		const size_t index = start - starts.begin();
+		valid &= start != starts.end() && *start == keyframe.event_offset && frames[index] == keyframe.event_frame;
+		valid &= keyframe.event_frame <= keyframe.frame && (index + 1 == frames.size() || frames[index + 1] > keyframe.frame);
+
+		valid &= (unsigned long)(in.end - in.at) >= keyframe.state_size && keyframe.state_size <= STATE_MAX_SIZE;
+		if (valid)
+		{
+			states.insert(states.end(), in.at, in.at + keyframe.state_size);
+			in.at += keyframe.state_size;
+			keyframes.push_back(keyframe);
+		}
+	}
+
+	if (!valid || keyframes.empty() || in.at != in.end)
+	{
+		std::cerr << file_path << " is not a movie of version " << MOVIE_VERSION << std::endl;
+		length = 0;
+		events.clear();
+		keyframes.clear();
+		states.clear();
+		return false;
+	}
+
+	frame       = 0;
+	event_frame = 0;
+	event_at    = 0;
+	return true;
+}
+
+/**
+ * @brief Put a machine in the state of a frame, from the keyframe before it
+ * @details
+ * The state of the keyframe is restored then the frames up to target are run, fewer than
+ * MOVIE_KEYFRAME of them. The machine must have loaded the rom the movie was recorded with
+ * @param chip8  machine to position, its instructions per frame become the ones of the movie
+ * @param target frame about to run, length to run the whole movie
+ * @return false when the frame is past the end or the rom is another one
+ */
+bool Movie::seek(CHIP_8 &chip8, u64 target)
+{
+	if (target > length || keyframes.empty())
+		return false;
+
+	const auto after = std::upper_bound(keyframes.begin(), keyframes.end(), target,
+		[](u64 value, const Movie_Keyframe &keyframe){ return value < keyframe.frame; });
+	const Movie_Keyframe &keyframe = *(after - 1);
+
+	if (chip8.image_id != image_id || !chip8.restore(states.data() + keyframe.state_offset, keyframe.state_size))
+	{
+		std::cerr << "The movie was recorded with another rom" << std::endl;
+		return false;
+	}
+	chip8.cycles_per_frame = cycles_per_frame;
+
+	frame       = keyframe.frame;
+	event_frame = keyframe.event_frame;
+	event_at    = keyframe.event_offset;
+
+	while (frame < target && play(chip8)){
+		chip8.run_frame();
+	}
+	return true;
+}
+
+/**
+ * @brief Press and release the keys of the next frame
+ * @details Called once per frame before CHIP_8::run_frame
+ * @param chip8 machine about to run a frame
+ * @return false at the end of the movie, no key is changed then
+ */
+bool Movie::play(CHIP_8 &chip8)
+{
+	if (frame >= length)
+		return false;
+
+	while (event_at < events.size())
+	{
+		Byte_Reader in = { events.data() + event_at, events.data() + events.size(), true };
+		const u64 at_frame = event_frame + Read_Count(in);
+		const u8  key      = in.byte();
+
+		if (at_frame > frame)
+			break;
+
+		chip8.cpu.key[key & 0x0F] = key & MOVIE_PRESSED ? 1 : 0;
+		event_frame = at_frame;
+		event_at    = in.at - events.data();
+	}
+
+	++frame;
+	return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file Movie.hpp
+ * @brief Keys pressed during a session, replayed frame by frame without window
+ * @see Movie.cpp
+ */
+#ifndef MOVIE_HPP
+#define MOVIE_HPP
+#include <vector>
+#include "CHIP_8.hpp"
+
+/*
+ * Version of the movie format, a movie of another version is refused
+ */
+#define MOVIE_VERSION 1
+
+/*
+ * Frames between two keyframes, 10 seconds
+ */
+#define MOVIE_KEYFRAME 600
+
+/*
+ * Bit of an event set when its key is pressed, the low nibble is the key
+ */
+#define MOVIE_PRESSED 0x10
+
+/*
+ * Save state of the machine about to run a frame, replay can start from it
+ */
+struct Movie_Keyframe
+{
+	u64           frame;          /* Frame about to run, its keys are pressed */
+	u64           event_frame;    /* Frame of the last event before event_offset */
+	unsigned long event_offset;   /* First event of a later frame */
+	unsigned long state_offset;   /* State in Movie::states, see State.cpp */
+	unsigned long state_size;
+};
+
+struct Movie
+{
+	/*
+	 * Session the keys belong to
+	 */
+	u32 image_id;
+	u32 seed;
+	u32 cycles_per_frame;
+
+	/*
+	 * Frames recorded
+	 */
+	u64 length;
+
+	/*
+	 * Key changes, each one the LEB128 count of frames since the previous one then the key
+	 * and MOVIE_PRESSED. Keys of a frame are changed before it runs
+	 */
+	std::vector<u8> events;
+
+	/*
+	 * Keyframes every MOVIE_KEYFRAME frames, the first one at frame 0, and their states
+	 */
+	std::vector<Movie_Keyframe> keyframes;
+	std::vector<u8>             states;
+
+	/*
+	 * Frames recorded or played so far, and the events up to them
+	 */
+	u64           frame;
+	u64           event_frame;
+	unsigned long event_at;
+	u8            keys[NUMBER_REGISTER];
+
+	Movie(void);
+
+	/**
+	 * @brief Start recording a machine which just loaded its rom and seeded its generator
+	 * @see   Movie.cpp
+	 */
+	void start(const CHIP_8 &chip8, u32 seed);
+
+	/**
+	 * @brief Record the keys of the frame about to run
+	 * @see   Movie.cpp
+	 */
+	void record(const CHIP_8 &chip8);
+
+	/**
+	 * @brief Write the movie into a file
+	 * @see   Movie.cpp
+	 * @return false when the file can not be written
+	 */
+	bool write(const char *file_path) const;
+
+	/**
+	 * @brief Read a movie written by write
+	 * @see   Movie.cpp
+	 * @return false when the file can not be read or is not a valid movie
+	 */
+	bool read(const char *file_path);
+
+	/**
+	 * @brief Put a machine in the state of a frame, from the keyframe before it
+	 * @see   Movie.cpp
+	 * @return false when the frame is past the end or the rom is another one
+	 */
+	bool seek(CHIP_8 &chip8, u64 target);
+
+	/**
+	 * @brief Press the keys of the next frame
+	 * @see   Movie.cpp
+	 * @return false at the end of the movie
+	 */
+	bool play(CHIP_8 &chip8);
+};
+
+#endif
@@ -0,0 +1,275 @@
+/**
+ * @file  Profile.cpp
+ * @brief Executions and host time of each adress, reported at exit, built with CHIP8_PROFILE only
+ * @details
+ * Every machine counts into its own profile, so machines of several threads never share
+ * counters. A profile is added to the one of its rom when its machine is destroyed or loads
+ * another rom, and machines still alive at exit are added then. The report of each rom
+ * gives the time of each class of opcodes, then the hottest loops, ended by a jump back,
+ * and the hottest basic blocks with their disassembly. Profiled machines always interpret
+ * and never skip idle loops, so every instruction goes through CHIP_8::emulate_cycle
+ */
+#ifdef CHIP8_PROFILE
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Profile.hpp"
+
+/*
+ * Profiles of every machine, the report is printed when the program exits.
+ * Never destroyed, static machines may close their profile after the report
+ */
+struct Profile_Registry
+{
+	std::mutex            lock;
+	std::vector<Profile*> live;    /* Profiles of machines alive */
+	std::vector<Profile*> closed;  /* Profiles of machines destroyed, one per rom */
+	bool                  started; /* The report is registered with atexit */
+	u64                   start_ticks;
+	std::chrono::steady_clock::time_point start_time;
+};
+
+static Profile_Registry &registry = *new Profile_Registry();
+
+/*
+ * Adresses of a loop or a block and what was spent in them
+ */
+struct Hot_Spot
+{
+	u16 first;      /* Adress of the first instruction */
+	u16 last;       /* Adress of the last instruction */
+	u64 runs;       /* Iterations of a loop, executions of a block */
+	u64 ticks;      /* Host time, outside of the loops inside a loop */
+};
+
+/**
+ * @brief Current time in ticks, the cycle counter when the host has one
+ */
+u64 Profile_Ticks(void)
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Add the counters of a profile to another of the same rom
+ */
+static void Merge(Profile &into, const Profile &from)
+{
+	for(unsigned adress = 0; adress < MEMORY_SIZE; ++adress)
+	{
+		if (!from.count[adress])
+			continue;
+
+		into.count[adress]  += from.count[adress];
+		into.ticks[adress]  += from.ticks[adress];
+		into.opcode[adress]  = from.opcode[adress];
+	}
+	for(unsigned c = 0; c < NUMBER_CLASS; ++c)
+	{
+		into.class_count[c] += from.class_count[c];
+		into.class_ticks[c] += from.class_ticks[c];
+	}
+}
+
+/**
+ * @brief Print the executed instructions between two adresses
+ */
+static void Print_Code(const Profile &profile, const Hot_Spot &spot, u64 total_ticks)
+{
+	char text[DISASSEMBLY_SIZE];
+
+	for(unsigned adress = spot.first; adress <= spot.last; ++adress)
+	{
+		if (!profile.count[adress])
+			continue;
+
+		Disassemble(profile.opcode[adress], text);
+		fprintf(stderr, "    %.3X  %.4X  %-16s %14llu %6.2f%%\n", adress, profile.opcode[adress], text,
+		        (unsigned long long)profile.count[adress], 100.0 * profile.ticks[adress] / total_ticks);
+	}
+}
+
+/**
+ * @brief Print the hottest spots of a rom, by host time
+ */
+static void Print_Spots(const Profile &profile, std::vector<Hot_Spot> &spots, const char *title, const char *runs,
+                        u64 total_ticks, double ns_per_tick)
+{
+	std::sort(spots.begin(), spots.end(), [](const Hot_Spot &a, const Hot_Spot &b){ return a.ticks > b.ticks; });
+
+	fprintf(stderr, "\n%s\n", title);
+	for(size_t i = 0; i < spots.size() && i < PROFILE_TOP; ++i)
+	{
+		const Hot_Spot &spot = spots[i];
+
+		fprintf(stderr, "  %.3X-%.3X  %14llu %s  %6.2f%% of time  %8.1f ns each\n", spot.first, spot.last,
+		        (unsigned long long)spot.runs, runs, 100.0 * spot.ticks / total_ticks, ns_per_tick * spot.ticks / spot.runs);
+		Print_Code(profile, spot, total_ticks);
+	}
+}
+
+/**
+ * @brief Print the report of a rom
+ */
+static void Report(const Profile &profile, double ns_per_tick)
+{
+	u64 executed = 0;
+	u64 total_ticks = 0;
+
+	for(unsigned c = 0; c < NUMBER_CLASS; ++c)
+	{
+		executed    += profile.class_count[c];
+		total_ticks += profile.class_ticks[c];
+	}
+	if (!executed)
+		return;
+	total_ticks = std::max<u64>(total_ticks, 1);
+
+	fprintf(stderr, "\nProfile of rom %.8X: %llu instructions, %.3f ms of host time\n", profile.image_id,
+	        (unsigned long long)executed, ns_per_tick * total_ticks / 1e6);
+
+	fprintf(stderr, "\n%-8s %14s %7s %7s\n", "class", "executed", "count", "time");
+	for(unsigned c = 0; c < NUMBER_CLASS; ++c)
+	{
+		if (!profile.class_count[c])
+			continue;
+
+		fprintf(stderr, "%-8s %14llu %6.2f%% %6.2f%%\n", Class_Name((Opcode_Class)c), (unsigned long long)profile.class_count[c],
+		        100.0 * profile.class_count[c] / executed, 100.0 * profile.class_ticks[c] / total_ticks);
+	}
+
+	// A loop is closed by a jump back, its iterations are the executions of the jump
+	std::vector<Hot_Spot> loops;
+	for(unsigned adress = 0; adress < MEMORY_SIZE; ++adress)
+	{
+		const u16 opcode = profile.opcode[adress];
+		if (profile.count[adress] && (opcode & 0xF000) == 0x1000 && (opcode & 0x0FFF) <= adress){
+			loops.push_back({ (u16)(opcode & 0x0FFF), (u16)adress, profile.count[adress], 0 });
+		}
+	}
+
+	// Time of the loops inside a loop is theirs, an outer loop is not hot for its inner ones
+	for(Hot_Spot &loop : loops)
+	{
+		std::vector<bool> nested(loop.last - loop.first + 1, false);
+
+		for(const Hot_Spot &inner : loops)
+		{
+			if (&inner == &loop || inner.first < loop.first || inner.last > loop.last)
+				continue;
+			std::fill(nested.begin() + (inner.first - loop.first), nested.begin() + (inner.last - loop.first + 1), true);
+		}
+		for(unsigned inside = loop.first; inside <= loop.last; ++inside)
+		{
+			if (!nested[inside - loop.first]){
+				loop.ticks += profile.ticks[inside];
+			}
+		}
+	}
+	Print_Spots(profile, loops, "Hottest loops", "iterations", total_ticks, ns_per_tick);
+
+	// A block goes on while the next instruction ran as many times and nothing branched
+	std::vector<Hot_Spot> blocks;
+	for(unsigned adress = 0; adress < MEMORY_SIZE; ++adress)
+	{
+		if (!profile.count[adress])
+			continue;
+
+		Hot_Spot block = { (u16)adress, (u16)adress, profile.count[adress], profile.ticks[adress] };
+		while (!Ends_Block(profile.opcode[block.last]) && block.last + 2u < MEMORY_SIZE &&
+		       profile.count[block.last + 2] == block.runs)
+		{
+			block.last  += 2;
+			block.ticks += profile.ticks[block.last];
+		}
+		blocks.push_back(block);
+		adress = block.last;
+	}
+	Print_Spots(profile, blocks, "Hottest blocks", "executions", total_ticks, ns_per_tick);
+}
+
+/**
+ * @brief Print the report of every rom, registered with atexit
+ */
+static void Report_All(void)
+{
+	std::lock_guard<std::mutex> guard(registry.lock);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.start_time).count();
+	const u64    ticks   = Profile_Ticks() - registry.start_ticks;
+	const double ns_per_tick = ticks ? seconds * 1e9 / ticks : 0;
+
+	// Machines still alive, the main one when the window is closed
+	std::vector<Profile*> roms = registry.closed;
+	for(Profile *profile : registry.live)
+	{
+		auto same = std::find_if(roms.begin(), roms.end(), [&](Profile *rom){ return rom->image_id == profile->image_id; });
+		if (same == roms.end())
+			roms.push_back(new Profile(*profile));
+		else
+			Merge(**same, *profile);
+	}
+
+	for(Profile *profile : roms){
+		Report(*profile, ns_per_tick);
+	}
+}
+
+/**
+ * @brief Profile of a machine which loaded a rom, reported at exit
+ * @param image_id rom of the machine
+ * @return counters of the machine, given back with Profile_Close
+ */
+Profile *Profile_Open(u32 image_id)
+{
+	std::lock_guard<std::mutex> guard(registry.lock);
+
+	if (!registry.started)
+	{
+		registry.started     = true;
+		registry.start_ticks = Profile_Ticks();
+		registry.start_time  = std::chrono::steady_clock::now();
+		atexit(Report_All);
+	}
+
+	Profile *profile  = new Profile();
+	profile->image_id = image_id;
+	registry.live.push_back(profile);
+	return profile;
+}
+
+/**
+ * @brief Add the counters of a machine to the ones of its rom
+ * @param profile counters given by Profile_Open, not used afterwards
+ */
+void Profile_Close(Profile *profile)
+{
+	std::lock_guard<std::mutex> guard(registry.lock);
+
+	registry.live.erase(std::find(registry.live.begin(), registry.live.end(), profile));
+
+	for(Profile *rom : registry.closed)
+	{
+		if (rom->image_id == profile->image_id)
+		{
+			Merge(*rom, *profile);
+			delete profile;
+			return;
+		}
+	}
+	registry.closed.push_back(profile);
+}
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file Profile.hpp
+ * @brief Executions and host time of each adress, reported at exit, built with CHIP8_PROFILE only
+ * @see Profile.cpp
+ */
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+#ifdef CHIP8_PROFILE
+#include "CPU/CPU.hpp"
+#include "Disassembler.hpp"
+
+/*
+ * Loops and blocks printed by the report of each rom
+ */
+#define PROFILE_TOP 8
+
+/*
+ * Counters of the machines running one rom
+ */
+struct Profile
+{
+	u32 image_id;                     /* Rom of the machines */
+	u64 count[MEMORY_SIZE];           /* Instructions executed at each adress */
+	u64 ticks[MEMORY_SIZE];           /* Host time spent on them, in ticks of Profile_Ticks */
+	u16 opcode[MEMORY_SIZE];          /* Last opcode executed at each adress */
+	u64 class_count[NUMBER_CLASS];
+	u64 class_ticks[NUMBER_CLASS];
+
+	/**
+	 * @brief Count an instruction executed at adress
+	 */
+	void record(u16 adress, u16 executed, u64 spent)
+	{
+		const Opcode_Class opcode_class = Classify_Opcode(executed);
+
+		adress &= MEMORY_SIZE - 1;
+		++count[adress];
+		ticks[adress]  += spent;
+		opcode[adress]  = executed;
+		++class_count[opcode_class];
+		class_ticks[opcode_class] += spent;
+	}
+};
+
+/**
+ * @brief Current time in ticks, the cycle counter when the host has one
+ * @see   Profile.cpp
+ */
+u64 Profile_Ticks(void);
+
+/**
+ * @brief Profile of a machine which loaded a rom, reported at exit
+ * @see   Profile.cpp
+ */
+Profile *Profile_Open(u32 image_id);
+
+/**
+ * @brief Add the counters of a machine to the ones of its rom
+ * @see   Profile.cpp
+ */
+void Profile_Close(Profile *profile);
+
+#endif
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file  Rewind.cpp
+ * @brief History of the last frames, played backwards one frame at a time
+ * @details
+ * Each frame adds an entry to a ring of bytes. An entry is the delta between the snapshot
+ * of the previous frame and the one of this frame, see Delta.hpp: XORing it into the newer
+ * snapshot gives the older one back, and a frame usually changes a few registers and rows
+ * so it costs tens of bytes. When the ring is full the oldest entries are forgotten.
+ * There are no keyframes: history is only ever undone from its newest entry, which needs
+ * the snapshot after it and nothing else, and forgetting the oldest entries never breaks
+ * that chain. A full snapshot every few seconds would cost bytes without being read
+ */
+#include <cstring>
+#include "Rewind.hpp"
+#include "Delta.hpp"
+#include "Static/Static.hpp"
+
+/*
+ * Largest entry, a delta of a snapshot which did not compress at all
+ */
+#define REWIND_ENTRY (sizeof(Snapshot) + 16)
+
+/**
+ * @brief Copy what a frame can change into a snapshot
+ */
+static void Take_Snapshot(const CHIP_8 &chip8, Snapshot &snapshot)
+{
+	const CPU &cpu = chip8.cpu;
+
+	memcpy(snapshot.gfx, cpu.gfx, sizeof(snapshot.gfx));
+	memcpy(snapshot.memory, cpu.memory, sizeof(snapshot.memory));
+	memcpy(snapshot.stack, cpu.stack, sizeof(snapshot.stack));
+	memcpy(snapshot.V, cpu.V, sizeof(snapshot.V));
+	snapshot.rng         = cpu.rng;
+	snapshot.I           = cpu.I;
+	snapshot.pc          = cpu.pc;
+	snapshot.sp          = cpu.sp;
+	snapshot.delay_timer = cpu.delay_timer;
+	snapshot.sound_timer = cpu.sound_timer;
+	snapshot.fault       = cpu.fault;
+	memset(snapshot.unused, 0, sizeof(snapshot.unused));
+}
+
+/**
+ * @brief Put a snapshot back into the machine, keys are left as they are
+ * @details Only memory which changes is written, its decoded instructions are forgotten
+ */
+static void Resume_Snapshot(CHIP_8 &chip8, const Snapshot &snapshot)
+{
+	CPU &cpu = chip8.cpu;
+
+	for(unsigned i = 0; i < MEMORY_SIZE; i += 32)
+	{
+		if (memcmp(cpu.memory + i, snapshot.memory + i, 32) == 0)
+			continue;
+
+		for(unsigned k = i; k < i + 32; ++k)
+		{
+			if (cpu.memory[k] != snapshot.memory[k])
+			{
+				cpu.memory[k] = snapshot.memory[k];
+				cpu.invalidate(k);
+			}
+		}
+	}
+	if (chip8.recompiled){
+		chip8.recompiled->flush();
+	}
+
+	memcpy(cpu.gfx, snapshot.gfx, sizeof(cpu.gfx));
+	memcpy(cpu.stack, snapshot.stack, sizeof(cpu.stack));
+	memcpy(cpu.V, snapshot.V, sizeof(cpu.V));
+	cpu.rng         = snapshot.rng;
+	cpu.I           = snapshot.I;
+	cpu.pc          = snapshot.pc;
+	cpu.sp          = snapshot.sp;
+	cpu.delay_timer = snapshot.delay_timer;
+	cpu.sound_timer = snapshot.sound_timer;
+	cpu.fault       = false;
+	cpu.dirty       = ~0u;
+	chip8.settled   = false;
+
+	// pc is still on the instruction which faulted
+	if (snapshot.fault){
+		cpu.raise_fault(cpu.pc, cpu.fetch(cpu.pc));
+	}
+}
+
+/**
+ * @brief Empty history of size bytes
+ */
+Rewind::Rewind(unsigned long size)
+{
+	ring     = new u8[size];
+	capacity = size;
+	image_id = 0;
+
+	memset(&current, 0, sizeof(current));
+	clear();
+}
+
+Rewind::~Rewind(void)
+{
+	delete[] ring;
+}
+
+/**
+ * @brief Forget every recorded frame, the next one recorded starts history again
+ */
+void Rewind::clear(void)
+{
+	tail    = 0;
+	head    = 0;
+	frames  = 0;
+	started = false;
+}
+
+/**
+ * @brief Write bytes at a position of the ring, wrapping around its end
+ */
+void Rewind::copy_in(unsigned long long position, const u8 *from, unsigned long size)
+{
+	unsigned long at    = position % capacity;
+	unsigned long first = capacity - at < size ? capacity - at : size;
+
+	memcpy(ring + at, from, first);
+	memcpy(ring, from + first, size - first);
+}
+
+/**
+ * @brief Read bytes at a position of the ring, wrapping around its end
+ */
+void Rewind::copy_out(unsigned long long position, u8 *to, unsigned long size) const
+{
+	unsigned long at    = position % capacity;
+	unsigned long first = capacity - at < size ? capacity - at : size;
+
+	memcpy(to, ring + at, first);
+	memcpy(to + first, ring, size - first);
+}
+
+/**
+ * @brief Forget the oldest entry
+ */
+void Rewind::drop(void)
+{
+	u32 tag;
+
+	copy_out(tail, (u8*)&tag, sizeof(tag));
+	tail += tag + 2 * sizeof(tag);
+	--frames;
+}
+
+/**
+ * @brief Add an entry after the newest one, forgetting the oldest ones to make room
+ * @details Its size is written before and after it, so the ring is walked from both ends
+ */
+void Rewind::push(const u8 *entry, unsigned long size)
+{
+	const u32 tag = (u32)size;
+	const unsigned long total = size + 2 * sizeof(tag);
+
+	if (total > capacity)
+	{
+		clear();
+		return;
+	}
+	while (head + total - tail > capacity){
+		drop();
+	}
+
+	copy_in(head, (const u8*)&tag, sizeof(tag));
+	copy_in(head + sizeof(tag), entry, size);
+	copy_in(head + sizeof(tag) + size, (const u8*)&tag, sizeof(tag));
+	head += total;
+	++frames;
+}
+
+/**
+ * @brief Record the machine at the end of a frame
+ * @details The first frame, or the first one after another rom was loaded, starts history
+ * @param chip8 machine which just ran a frame
+ */
+void Rewind::record(const CHIP_8 &chip8)
+{
+	if (!started || chip8.image_id != image_id)
+	{
+		clear();
+		image_id = chip8.image_id;
+		started  = true;
+		Take_Snapshot(chip8, current);
+		return;
+	}
+
+	Snapshot next;
+	Take_Snapshot(chip8, next);
+
+	u8 entry[REWIND_ENTRY];
+	Byte_Writer out = { entry, entry + sizeof(entry), true };
+
+	Write_Delta(out, (const u8*)&current, (const u8*)&next, sizeof(Snapshot));
+
+	// History without this frame could not be played back, it starts over
+	if (out.ok)
+		push(entry, out.at - entry);
+	else
+		clear();
+	current = next;
+}
+
+/**
+ * @brief Put the machine back to the previous recorded frame
+ * @details The entry is taken off history, recording again continues from that frame
+ * @param chip8 machine to rewind
+ * @return false when history is empty
+ */
+bool Rewind::step_back(CHIP_8 &chip8)
+{
+	if (frames == 0)
+		return false;
+
+	u32 tag;
+	copy_out(head - sizeof(tag), (u8*)&tag, sizeof(tag));
+
+	const unsigned long size = tag;
+	u8 entry[REWIND_ENTRY];
+	copy_out(head - sizeof(tag) - size, entry, size);
+
+	Apply_Delta(Byte_Reader{ entry, entry + size, true }, (u8*)&current);
+
+	head -= size + 2 * sizeof(tag);
+	--frames;
+
+	Resume_Snapshot(chip8, current);
+	return true;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file Rewind.hpp
+ * @brief History of the last frames, played backwards one frame at a time
+ * @see Rewind.cpp
+ */
+#ifndef REWIND_HPP
+#define REWIND_HPP
+#include "CHIP_8.hpp"
+
+/*
+ * Bytes of history kept by default, older frames are forgotten first
+ */
+#define REWIND_SIZE (4ul << 20)
+
+/*
+ * Machine at the end of a frame, laid out without padding so that deltas of two snapshots
+ * only hold what the program changed. Keys are left out, they belong to the player
+ */
+struct Snapshot
+{
+	u64 gfx[L];
+	u8  memory[MEMORY_SIZE];
+	u32 rng;
+	u16 stack[NUMBER_REGISTER];
+	u16 I;
+	u16 pc;
+	u8  V[NUMBER_REGISTER];
+	u8  sp;
+	u8  delay_timer;
+	u8  sound_timer;
+	u8  fault;
+	u8  unused[4];
+};
+
+struct Rewind
+{
+	/*
+	 * Entries of history, oldest first, each one between its size and a copy of it
+	 */
+	u8 *ring;
+	unsigned long capacity;
+
+	/*
+	 * Positions of the oldest and past the newest byte, they only grow
+	 */
+	unsigned long long tail;
+	unsigned long long head;
+
+	/*
+	 * Frames which can be stepped back
+	 */
+	unsigned long frames;
+
+	/*
+	 * Last recorded frame, the next delta is made against it
+	 */
+	Snapshot current;
+
+	/*
+	 * Image of the rom history belongs to, history starts over with another rom
+	 */
+	u32  image_id;
+	bool started;
+
+	Rewind(unsigned long size = REWIND_SIZE);
+	~Rewind(void);
+
+	/* The ring is owned */
+	Rewind(const Rewind&) = delete;
+	Rewind &operator=(const Rewind&) = delete;
+
+	/**
+	 * @brief Record the machine at the end of a frame
+	 * @see   Rewind.cpp
+	 */
+	void record(const CHIP_8 &chip8);
+
+	/**
+	 * @brief Put the machine back to the previous recorded frame
+	 * @see   Rewind.cpp
+	 * @return false when history is empty
+	 */
+	bool step_back(CHIP_8 &chip8);
+
+	/**
+	 * @brief Forget every recorded frame
+	 * @see   Rewind.cpp
+	 */
+	void clear(void);
+
+private:
+	void push(const u8 *entry, unsigned long size);
+	void drop(void);
+	void copy_in(unsigned long long position, const u8 *from, unsigned long size);
+	void copy_out(unsigned long long position, u8 *to, unsigned long size) const;
+};
+
+#endif
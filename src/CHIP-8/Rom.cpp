@@ -0,0 +1,211 @@
+/**
+ * @file  Rom.cpp
+ * @brief Roms read once per process and shared by every machine which loads them
+ * @details
+ * A file is mapped, its size checked against ROM_MAX_SIZE before anything is read, then
+ * copied once. Roms are kept by path and by hash of their content, so the same file loaded
+ * by thousands of machines is read a single time and identical files share one copy. A file
+ * changed on disk after it was read is not seen again by this process. Roms of the bundle
+ * are copied from the binary itself
+ */
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Rom.hpp"
+#include "Bundle.hpp"
+#include "Hash.hpp"
+
+/*
+ * Roms read so far, machines of several threads load roms at once
+ */
+struct Rom_Cache
+{
+	std::mutex                                         lock;
+	std::unordered_map<std::string, const Rom*>        by_path;
+	std::unordered_map<u64, const Rom*>                by_hash;
+	std::unordered_map<const Bundled_Rom*, const Rom*> by_bundle;
+};
+
+static Rom_Cache cache;
+
+/**
+ * @brief Check the size of a rom before reading it
+ * @return false when it is empty or does not fit in memory
+ */
+static bool Check_Size(const char *file_path, long long size)
+{
+	if (size == 0)
+	{
+		std::cerr << "ROM " << file_path << " is empty" << std::endl;
+		return false;
+	}
+	if (size > ROM_MAX_SIZE)
+	{
+		std::cerr << "ROM " << file_path << " is too large to fit in memory" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Map a file and copy it into rom
+ * @return false when the file can not be read or does not fit in memory
+ */
+static bool Read_Rom(const char *file_path, Rom &rom)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cerr << "Failed to open ROM " << file_path << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		std::cerr << "Failed to read ROM " << file_path << std::endl;
+		CloseHandle(file);
+		return false;
+	}
+	if (!Check_Size(file_path, size.QuadPart))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view)
+	{
+		std::cerr << "Failed to read ROM " << file_path << std::endl;
+		if (mapping){
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+
+	rom.size = (unsigned long)size.QuadPart;
+	memcpy(rom.data, view, rom.size);
+
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	int file = open(file_path, O_RDONLY);
+	if (file < 0)
+	{
+		std::cerr << "Failed to open ROM " << file_path << std::endl;
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		std::cerr << "ROM " << file_path << " is not a file" << std::endl;
+		close(file);
+		return false;
+	}
+	if (!Check_Size(file_path, status.st_size))
+	{
+		close(file);
+		return false;
+	}
+
+	void *view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (view == MAP_FAILED)
+	{
+		std::cerr << "Failed to read ROM " << file_path << std::endl;
+		close(file);
+		return false;
+	}
+
+	rom.size = (unsigned long)status.st_size;
+	memcpy(rom.data, view, rom.size);
+
+	munmap(view, (size_t)status.st_size);
+	close(file);
+#endif
+	rom.hash = Hash(rom.data, rom.size);
+	return true;
+}
+
+/**
+ * @brief Rom of a file, read the first time only
+ * @param file_path path of the rom, the same path gives the same rom afterwards
+ * @return nullptr when the file can not be read or does not fit in memory
+ */
+const Rom *Rom_Load(const char *file_path)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	auto known = cache.by_path.find(file_path);
+	if (known != cache.by_path.end())
+		return known->second;
+
+	Rom *rom = new Rom();
+	if (!Read_Rom(file_path, *rom))
+	{
+		delete rom;
+		return nullptr;
+	}
+
+	// Another path to the same content
+	auto same = cache.by_hash.find(rom->hash);
+	if (same != cache.by_hash.end() && same->second->size == rom->size && memcmp(same->second->data, rom->data, rom->size) == 0)
+	{
+		delete rom;
+		return cache.by_path[file_path] = same->second;
+	}
+
+	cache.by_hash.emplace(rom->hash, rom);
+	return cache.by_path[file_path] = rom;
+}
+
+/**
+ * @brief Rom compiled into the emulator, no file is read
+ * @param name name of the rom in roms/, case is ignored
+ * @return nullptr when the bundle has no rom of that name
+ */
+const Rom *Rom_Bundled(const char *name)
+{
+	const Bundled_Rom *bundled = Bundle_Find(name);
+	if (!bundled)
+	{
+		std::cerr << "No rom named " << name << " in the bundle:";
+		for(unsigned i = 0; i < Bundle_Count(); ++i){
+			std::cerr << " " << Bundle_Get(i).name;
+		}
+		std::cerr << std::endl;
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	const Rom *&known = cache.by_bundle[bundled];
+	if (!known)
+	{
+		Rom *rom  = new Rom();
+		rom->hash = bundled->hash;
+		rom->size = bundled->size;
+		memcpy(rom->data, bundled->data, bundled->size);
+		known = rom;
+	}
+	return known;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file Rom.hpp
+ * @brief Roms read once per process and shared by every machine which loads them
+ * @see Rom.cpp
+ */
+#ifndef ROM_HPP
+#define ROM_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Largest rom, it must fit in memory after START_ADRESS
+ */
+#define ROM_MAX_SIZE (MEMORY_SIZE - START_ADRESS)
+
+/*
+ * Content of a rom file, never freed once read
+ */
+struct Rom
+{
+	u64           hash;               /* FNV-1a hash of the content */
+	unsigned long size;               /* Bytes of the rom */
+	u8            data[ROM_MAX_SIZE];
+};
+
+/**
+ * @brief Rom of a file, read the first time only
+ * @see   Rom.cpp
+ * @return nullptr when the file can not be read or does not fit in memory
+ */
+const Rom *Rom_Load(const char *file_path);
+
+/**
+ * @brief Rom compiled into the emulator, no file is read
+ * @see   Rom.cpp
+ * @return nullptr when the bundle has no rom of that name
+ */
+const Rom *Rom_Bundled(const char *name);
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file  State.cpp
+ * @brief Save states of a machine in a compact binary format
+ * @details
+ * A state starts with a header: the magic "C8ST", the version, flags and the id of the
+ * image the rom loaded. Registers, timers, keys, the random generator and the stack follow,
+ * multi-byte values in little endian. Memory is stored as a delta against the image and the
+ * screen as a delta against a blank screen, see Delta.hpp. Most of memory is the rom itself
+ * and most of the screen is dark, so a state is a few hundred bytes
+ */
+#include <cstring>
+#include "CHIP_8.hpp"
+#include "Delta.hpp"
+#include "Static/Static.hpp"
+
+/*
+ * First bytes of every state
+ */
+static constexpr const u8 state_magic[4] = { 'C', '8', 'S', 'T' };
+
+/*
+ * Bit of the flags set when the CPU faulted
+ */
+#define STATE_FAULT 0x01
+
+/*
+ * Bytes of the screen, 8 per row
+ */
+#define SCREEN_SIZE (L * 8)
+
+/**
+ * @brief Memory of the machine becomes image with the runs applied
+ * @details Only bytes which change are written, their decoded instructions are forgotten
+ * @param in runs already checked by Check_Delta
+ */
+static void Apply_Memory(Byte_Reader in, CPU &cpu, const u8 *image)
+{
+	unsigned i = 0;
+
+	for(;;)
+	{
+		const unsigned skip    = in.count();
+		const unsigned changed = in.count();
+		const unsigned equal   = changed ? i + skip : MEMORY_SIZE;
+
+		// Bytes equal to the image, most of them already are
+		if (memcmp(cpu.memory + i, image + i, equal - i) != 0)
+		{
+			for(; i < equal; ++i)
+			{
+				if (cpu.memory[i] != image[i])
+				{
+					cpu.memory[i] = image[i];
+					cpu.invalidate(i);
+				}
+			}
+		}
+		if (changed == 0)
+			return;
+
+		for(i = equal; i < equal + changed; ++i)
+		{
+			const u8 value = image[i] ^ *in.at++;
+			if (cpu.memory[i] != value)
+			{
+				cpu.memory[i] = value;
+				cpu.invalidate(i);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Write the state of the machine into buffer
+ * @details STATE_MAX_SIZE bytes are always enough
+ * @param buffer   receives the state
+ * @param capacity size of buffer
+ * @return size of the state, 0 when buffer is too small
+ */
+unsigned long CHIP_8::save(u8 *buffer, unsigned long capacity) const
+{
+	Byte_Writer out = { buffer, buffer + capacity, true };
+
+	for(u8 byte : state_magic){
+		out.byte(byte);
+	}
+	out.byte(STATE_VERSION);
+	out.byte(cpu.fault ? STATE_FAULT : 0);
+	out.dword(image_id);
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		out.byte(cpu.V[i]);
+	}
+	out.word(cpu.I);
+	out.word(cpu.pc);
+	out.byte(cpu.delay_timer);
+	out.byte(cpu.sound_timer);
+
+	u16 keys = 0;
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		keys |= (cpu.key[i] != 0) << i;
+	}
+	out.word(keys);
+	out.dword(cpu.rng);
+
+	out.byte(cpu.sp);
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		out.word(cpu.stack[i]);
+	}
+
+	Write_Delta(out, cpu.memory, image, MEMORY_SIZE);
+
+	u8 screen[SCREEN_SIZE];
+	static const u8 blank[SCREEN_SIZE] = {};
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(screen, cpu.gfx, SCREEN_SIZE);
+#else
+	for(unsigned row = 0; row < L; ++row)
+	{
+		for(unsigned b = 0; b < 8; ++b){
+			screen[row * 8 + b] = (u8)(cpu.gfx[row] >> (8 * b));
+		}
+	}
+#endif
+	Write_Delta(out, screen, blank, SCREEN_SIZE);
+
+	return out.ok ? (unsigned long)(out.at - buffer) : 0;
+}
+
+/**
+ * @brief Restore a state written by save
+ * @details
+ * Everything is read before the machine is touched. Instructions decoded or translated from
+ * bytes the state changes are forgotten, the whole screen is redrawn
+ * @param buffer state written by save
+ * @param size   size of the state
+ * @return false when the state is invalid or belongs to another rom, the machine is unchanged
+ */
+bool CHIP_8::restore(const u8 *buffer, unsigned long size)
+{
+	Byte_Reader in = { buffer, buffer + size, true };
+
+	for(u8 byte : state_magic)
+	{
+		if (in.byte() != byte)
+			return false;
+	}
+	if (in.byte() != STATE_VERSION)
+		return false;
+
+	const u8 flags = in.byte();
+	if (in.dword() != image_id)
+		return false;
+
+	u8 V[NUMBER_REGISTER];
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		V[i] = in.byte();
+	}
+	const u16 I           = in.word();
+	const u16 pc          = in.word();
+	const u8  delay_timer = in.byte();
+	const u8  sound_timer = in.byte();
+	const u16 keys        = in.word();
+	const u32 rng         = in.dword();
+
+	// A deeper stack pointer would let the next call write past the stack
+	const u8 sp = in.byte();
+	if (sp > NUMBER_REGISTER)
+		return false;
+
+	u16 stack[NUMBER_REGISTER];
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		stack[i] = in.word();
+	}
+
+	const Byte_Reader memory = in;
+	if (!Check_Delta(in, MEMORY_SIZE))
+		return false;
+
+	const Byte_Reader screen = in;
+	if (!Check_Delta(in, SCREEN_SIZE) || in.at != in.end)
+		return false;
+
+	// The state is valid
+	Apply_Memory(memory, cpu, image);
+	if (recompiled){
+		recompiled->flush();
+	}
+
+	memcpy(cpu.V, V, sizeof(V));
+	memcpy(cpu.stack, stack, sizeof(stack));
+	cpu.I           = I;
+	cpu.pc          = pc;
+	cpu.sp          = sp;
+	cpu.delay_timer = delay_timer;
+	cpu.sound_timer = sound_timer;
+	cpu.rng         = rng;
+	cpu.fault       = false;
+	settled         = false;
+
+	// pc is still on the instruction which faulted
+	if (flags & STATE_FAULT){
+		cpu.raise_fault(pc, cpu.fetch(pc));
+	}
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		cpu.key[i] = keys >> i & 1;
+	}
+
+	u8 bytes[SCREEN_SIZE] = {};
+	Apply_Delta(screen, bytes);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy(cpu.gfx, bytes, SCREEN_SIZE);
+#else
+	for(unsigned row = 0; row < L; ++row)
+	{
+		u64 bits = 0;
+		for(unsigned b = 0; b < 8; ++b){
+			bits |= (u64)bytes[row * 8 + b] << (8 * b);
+		}
+		cpu.gfx[row] = bits;
+	}
+#endif
+	cpu.dirty = ~0u;
+	return true;
+}
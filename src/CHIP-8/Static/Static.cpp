@@ -0,0 +1,173 @@
+/**
+ * @file  Static.cpp
+ * @brief Roms recompiled into C++ before the emulator is built
+ * @details
+ * Static_Data.hpp is generated from roms/ by tools/Recompile.cpp, see the Makefile. It holds
+ * the instructions reachable from START_ADRESS of every rom, cut in blocks of instructions
+ * following each other. Each block is a function executing them with their operands as
+ * constants, skips, jumps and calls inside the block are gotos so loops stay in it, and
+ * nothing is written into executable memory while the emulator runs.
+ * A block is entered at any of its instructions and counts the ones it executes, so a frame
+ * can stop and resume in the middle of it. Its bytes are compared with the rom before it
+ * runs, again after memory is written over it, and a block which differs is interpreted.
+ * Adresses no block holds, such as the targets of Bnnn, are interpreted too
+ */
+#include <climits>
+#include <cstring>
+#include "Static.hpp"
+
+/*
+ * Statements ending an instruction of a generated block, left counts the instructions the
+ * block may still execute. STATIC_GO goes on at an instruction of the block while some are
+ * left, STATIC_LEAVE returns to Static::run with pc at adress, STATIC_END returns with pc
+ * set by the instruction
+ */
+#define STATIC_GO(adress, label) do { if (--left == 0){ cpu.pc = (adress); return count; } goto label; } while (0)
+#define STATIC_LEAVE(adress)     do { --left; cpu.pc = (adress); return count - left; } while (0)
+#define STATIC_END()             do { --left; return count - left; } while (0)
+
+#include "Static_Data.hpp"
+
+/**
+ * @brief No rom chosen yet
+ */
+Static::Static(void)
+{
+	program  = nullptr;
+	image_id = 0;
+	memset(slots, 0, sizeof(slots));
+	memset(checked, 0, sizeof(checked));
+}
+
+/**
+ * @brief Choose the blocks of an image
+ * @details Slots are only filled again when the image changes
+ * @param id image_id of the machine, see CHIP_8::load
+ * @return false when the rom was not recompiled, it is then interpreted
+ */
+bool Static::select(u32 id)
+{
+	if (id == image_id)
+		return program != nullptr;
+
+	image_id = id;
+	program  = nullptr;
+	memset(slots, 0, sizeof(slots));
+	flush();
+
+	for(const Static_Program *candidate = static_programs; candidate->blocks; ++candidate)
+	{
+		if (candidate->image_id == id)
+		{
+			program = candidate;
+			break;
+		}
+	}
+	if (!program)
+		return false;
+
+	for(unsigned i = 0; i < program->count; ++i)
+	{
+		const Static_Block &block = program->blocks[i];
+		for(unsigned k = 0; k < block.length; ++k)
+		{
+			Slot &slot = slots[block.adress + 2 * k];
+			slot.block = i + 1;
+			slot.at    = k;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Compare every block with memory again before it runs
+ * @details Called when memory was rewritten by a rom, a state or the rewind
+ */
+void Static::flush(void)
+{
+	memset(checked, 0, sizeof(checked));
+}
+
+/**
+ * @brief Whether memory still holds the bytes a block was compiled from
+ * @details The result is kept until memory is written over the block
+ */
+bool Static::same(const CPU &cpu, unsigned block)
+{
+	if (!checked[block])
+	{
+		const Static_Block &code = program->blocks[block];
+		const bool equal = memcmp(cpu.memory + code.adress, program->rom + (code.adress - START_ADRESS), code.length * 2) == 0;
+		checked[block] = equal ? STATIC_SAME : STATIC_MODIFIED;
+	}
+	return checked[block] == STATIC_SAME;
+}
+
+/**
+ * @brief Check again the blocks memory was written over since written_low was reset
+ * @details An instruction holding a written byte starts at it or at the adress before
+ * @param low  lowest adress written during the run, extended with the written range
+ * @param high highest adress written during the run, extended with the written range
+ */
+void Static::written(CPU &cpu, u16 &low, u16 &high)
+{
+	if (cpu.written_low > cpu.written_high)
+		return;
+
+	const unsigned first = cpu.written_low > 0 ? cpu.written_low - 1u : 0u;
+	for (unsigned adress = first; adress <= cpu.written_high; ++adress)
+	{
+		const Slot &slot = slots[adress];
+		if (slot.block){
+			checked[slot.block - 1] = 0;
+		}
+	}
+
+	if (cpu.written_low < low)   low  = cpu.written_low;
+	if (cpu.written_high > high) high = cpu.written_high;
+	cpu.written_low  = MEMORY_SIZE;
+	cpu.written_high = 0;
+}
+
+/**
+ * @brief Execute exactly cycles instructions, or less when the CPU faults or waits for a key
+ * @details
+ * A block runs while it stays inside itself and cycles are left, other instructions go to
+ * the interpreter. A block leaves after Fx33 or Fx55, then the blocks they wrote over are
+ * checked again before anything else runs. The written range is given back to the caller
+ * as it would be after the interpreter
+ */
+unsigned long Static::run(CHIP_8 &chip8, unsigned long cycles)
+{
+	CPU &cpu = chip8.cpu;
+	unsigned long done = 0;
+
+	u16 low  = cpu.written_low;
+	u16 high = cpu.written_high;
+	cpu.written_low  = MEMORY_SIZE;
+	cpu.written_high = 0;
+
+	while (done < cycles && !cpu.fault && !cpu.waiting)
+	{
+		const Slot *slot = cpu.pc < MEMORY_SIZE ? &slots[cpu.pc] : nullptr;
+
+		if (slot && slot->block && same(cpu, slot->block - 1))
+		{
+			const unsigned long left = cycles - done;
+			const unsigned count = left < UINT_MAX ? (unsigned)left : UINT_MAX;
+
+			done += program->blocks[slot->block - 1].entry(cpu, slot->at, count);
+		}
+		else
+		{
+			chip8.emulate_cycle();
+			++done;
+		}
+
+		written(cpu, low, high);
+	}
+
+	cpu.written_low  = low;
+	cpu.written_high = high;
+	return done;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file Static.hpp
+ * @brief Roms recompiled into C++ before the emulator is built
+ * @see Static.cpp
+ */
+#ifndef STATIC_HPP
+#define STATIC_HPP
+#include "../CHIP_8.hpp"
+
+/*
+ * Longest block written by tools/Recompile.cpp, in instructions
+ */
+#define STATIC_BLOCK_LENGTH 128
+
+/*
+ * Values of Static::checked, a block which was not checked yet is 0
+ */
+#define STATIC_SAME     1
+#define STATIC_MODIFIED 2
+
+/*
+ * Compiled code of a block, it executes at most count instructions from the one at index at,
+ * count is at least 1. pc is left after the last one
+ * @return number of instructions executed
+ */
+typedef unsigned (*Static_Entry)(CPU &cpu, unsigned at, unsigned count);
+
+/*
+ * Instructions following each other in a rom, generated by tools/Recompile.cpp
+ */
+struct Static_Block
+{
+	u16          adress;   /* First instruction */
+	u8           length;   /* Instructions of the block */
+	Static_Entry entry;
+};
+
+/*
+ * Blocks of a rom, generated by tools/Recompile.cpp
+ */
+struct Static_Program
+{
+	u32                 image_id;  /* Of the image the rom loads, see CHIP_8::load */
+	const char         *name;      /* File name in roms/ */
+	const u8           *rom;       /* Bytes the blocks were compiled from, at START_ADRESS */
+	unsigned long       size;
+	const Static_Block *blocks;    /* Sorted by adress */
+	unsigned            count;
+};
+
+struct Static
+{
+	/*
+	 * Block and position of an adress of memory
+	 */
+	struct Slot
+	{
+		u16 block;   /* Index of the block plus one, 0 when the adress was not compiled */
+		u8  at;      /* Instructions of the block before the adress */
+	};
+
+	/*
+	 * Blocks of the loaded rom, null when it was not recompiled
+	 */
+	const Static_Program *program;
+
+	/*
+	 * Image program was chosen for
+	 */
+	u32 image_id;
+
+	/*
+	 * Slot of each adress of memory, odd ones included since some roms run there
+	 */
+	Slot slots[MEMORY_SIZE];
+
+	/*
+	 * Of each block: 0 when memory has to be compared with the rom before it runs,
+	 * STATIC_SAME when it was, STATIC_MODIFIED when it differs and is interpreted
+	 */
+	u8 checked[MEMORY_SIZE];
+
+	Static(void);
+
+	/**
+	 * @brief Choose the blocks of an image
+	 * @see   Static.cpp
+	 * @return false when the rom was not recompiled
+	 */
+	bool select(u32 id);
+
+	/**
+	 * @brief Compare every block with memory again before it runs
+	 * @see   Static.cpp
+	 */
+	void flush(void);
+
+	/**
+	 * @brief Execute instructions, compiled blocks when memory still holds them
+	 * @see   Static.cpp
+	 * @return number of instructions executed
+	 */
+	unsigned long run(CHIP_8 &chip8, unsigned long cycles);
+
+private:
+	bool same(const CPU &cpu, unsigned block);
+	void written(CPU &cpu, u16 &low, u16 &high);
+};
+
+#endif
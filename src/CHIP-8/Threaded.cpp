@@ -0,0 +1,313 @@
+/**
+ * @file  Threaded.cpp
+ * @brief Direct-threaded interpreter of CHIP-8
+ * @details
+ * Every instruction ends by fetching the next one and jumping straight to its label, so each
+ * label has its own indirect branch that the host predictor learns separately. It uses labels
+ * as values of GCC and Clang, other compilers get the switch interpreter
+ * @see CPU.cpp for the behaviour of each instruction
+ */
+#include "CHIP_8.hpp"
+#include <cstring>
+
+/*
+ * Labels of the threaded interpreter, simple instructions have their own code,
+ * the other ones go through their CPU handler
+ */
+enum Label
+{
+	LABEL_HANDLER,
+	LABEL_00EE,
+	LABEL_1nnn,
+	LABEL_2nnn,
+	LABEL_3xkk,
+	LABEL_4xkk,
+	LABEL_5xy0,
+	LABEL_6xkk,
+	LABEL_7xkk,
+	LABEL_8xy0,
+	LABEL_8xy1,
+	LABEL_8xy2,
+	LABEL_8xy3,
+	LABEL_8xy4,
+	LABEL_8xy5,
+	LABEL_8xy6,
+	LABEL_8xy7,
+	LABEL_8xyE,
+	LABEL_9xy0,
+	LABEL_Annn,
+	LABEL_Bnnn,
+	LABEL_Ex9E,
+	LABEL_ExA1,
+	LABEL_Fx07,
+	LABEL_Fx15,
+	LABEL_Fx18,
+	LABEL_Fx1E,
+	LABEL_Fx29
+};
+
+/*
+ * Label of every opcode indexed by the high nibble then the low byte, built once at startup
+ */
+struct Label_Table
+{
+	u8 label[16][256];
+
+	Label_Table(void);
+};
+
+/**
+ * @brief Fill the label table, opcodes which are not listed use their handler
+ */
+Label_Table::Label_Table(void)
+{
+	memset(label, LABEL_HANDLER, sizeof(label));
+
+	for(unsigned n = 0; n < 16; ++n){
+		label[0x0][n << 4 | 0xE] = LABEL_00EE;
+	}
+
+	memset(label[0x1], LABEL_1nnn, sizeof(label[0x1]));
+	memset(label[0x2], LABEL_2nnn, sizeof(label[0x2]));
+	memset(label[0x3], LABEL_3xkk, sizeof(label[0x3]));
+	memset(label[0x4], LABEL_4xkk, sizeof(label[0x4]));
+	memset(label[0x6], LABEL_6xkk, sizeof(label[0x6]));
+	memset(label[0x7], LABEL_7xkk, sizeof(label[0x7]));
+	memset(label[0xA], LABEL_Annn, sizeof(label[0xA]));
+	memset(label[0xB], LABEL_Bnnn, sizeof(label[0xB]));
+
+	for(unsigned y = 0; y < 16; ++y)
+	{
+		memset(&label[0x5][y << 4], LABEL_5xy0, 16);
+		memset(&label[0x9][y << 4], LABEL_9xy0, 16);
+		label[0x8][y << 4 | 0x0] = LABEL_8xy0;
+		label[0x8][y << 4 | 0x1] = LABEL_8xy1;
+		label[0x8][y << 4 | 0x2] = LABEL_8xy2;
+		label[0x8][y << 4 | 0x3] = LABEL_8xy3;
+		label[0x8][y << 4 | 0x4] = LABEL_8xy4;
+		label[0x8][y << 4 | 0x5] = LABEL_8xy5;
+		label[0x8][y << 4 | 0x6] = LABEL_8xy6;
+		label[0x8][y << 4 | 0x7] = LABEL_8xy7;
+		label[0x8][y << 4 | 0xE] = LABEL_8xyE;
+	}
+
+	label[0xE][0x9E] = LABEL_Ex9E;
+	label[0xE][0xA1] = LABEL_ExA1;
+
+	label[0xF][0x07] = LABEL_Fx07;
+	label[0xF][0x15] = LABEL_Fx15;
+	label[0xF][0x18] = LABEL_Fx18;
+	label[0xF][0x1E] = LABEL_Fx1E;
+	label[0xF][0x29] = LABEL_Fx29;
+}
+
+static const Label_Table threaded;
+
+/**
+ * @brief Execute exactly cycles instructions, or less when the CPU faults or waits for a key, with the threaded interpreter
+ * @details Instructions at odd adresses or outside memory go through emulate_cycle
+ * @param cycles number of instructions to execute
+ * @return number of instructions executed
+ */
+unsigned long CHIP_8::run_threaded(unsigned long cycles)
+{
+	unsigned long done = 0;
+
+	if (cycles == 0 || cpu.fault){
+		return 0;
+	}
+
+#if defined(__GNUC__)
+	static void *const labels[] =
+	{
+		&&op_handler,
+		&&op_00EE, &&op_1nnn, &&op_2nnn, &&op_3xkk, &&op_4xkk, &&op_5xy0, &&op_6xkk, &&op_7xkk,
+		&&op_8xy0, &&op_8xy1, &&op_8xy2, &&op_8xy3, &&op_8xy4, &&op_8xy5, &&op_8xy6, &&op_8xy7, &&op_8xyE,
+		&&op_9xy0, &&op_Annn, &&op_Bnnn, &&op_Ex9E, &&op_ExA1,
+		&&op_Fx07, &&op_Fx15, &&op_Fx18, &&op_Fx1E, &&op_Fx29
+	};
+
+	u8 *const V = cpu.V;
+	u16 opcode;
+
+/*
+ * Operands of the current opcode
+ */
+#define NNN (opcode & 0x0FFF)
+#define KK  (opcode & 0x00FF)
+#define VX  V[(opcode & 0x0F00) >> 8]
+#define VY  V[(opcode & 0x00F0) >> 4]
+
+/*
+ * Fetch the next instruction and jump to its label
+ */
+#define DISPATCH()                                                            \
+	if (cpu.pc & 1 || cpu.pc >= MEMORY_SIZE) goto slow;                        \
+	opcode  = cpu.memory[cpu.pc] << 8 | cpu.memory[cpu.pc + 1];               \
+	cpu.pc += 2;                                                              \
+	goto *labels[threaded.label[opcode >> 12][opcode & 0x00FF]]
+
+/*
+ * End of an instruction
+ */
+#define NEXT()                                                                \
+	if (++done == cycles) return done;                                        \
+	DISPATCH()
+
+	DISPATCH();
+
+slow:
+	emulate_cycle();
+	if (++done == cycles || cpu.fault || cpu.waiting){
+		return done;
+	}
+	DISPATCH();
+
+op_handler:
+	cpu.ins    = &decode(cpu.pc - 2);
+	cpu.opcode = opcode;
+	cpu.ins->handler(cpu);
+	if (cpu.fault || cpu.waiting){
+		return ++done;
+	}
+	NEXT();
+
+op_00EE:
+	// The handler faults on an empty stack
+	if (cpu.sp == 0){
+		goto op_handler;
+	}
+	cpu.sp--;
+	cpu.pc = cpu.stack[cpu.sp];
+	NEXT();
+
+op_1nnn:
+	cpu.pc = NNN;
+	NEXT();
+
+op_2nnn:
+	// The handler faults on a full stack
+	if (cpu.sp >= NUMBER_REGISTER){
+		goto op_handler;
+	}
+	cpu.stack[cpu.sp] = cpu.pc;
+	++cpu.sp;
+	cpu.pc = NNN;
+	NEXT();
+
+op_3xkk:
+	cpu.pc += (VX == KK) ? 2 : 0;
+	NEXT();
+
+op_4xkk:
+	cpu.pc += (VX != KK) ? 2 : 0;
+	NEXT();
+
+op_5xy0:
+	cpu.pc += (VX == VY) ? 2 : 0;
+	NEXT();
+
+op_6xkk:
+	VX = KK;
+	NEXT();
+
+op_7xkk:
+	VX += KK;
+	NEXT();
+
+op_8xy0:
+	VX = VY;
+	NEXT();
+
+op_8xy1:
+	VX |= VY;
+	NEXT();
+
+op_8xy2:
+	VX &= VY;
+	NEXT();
+
+op_8xy3:
+	VX ^= VY;
+	NEXT();
+
+op_8xy4:
+	VX  += VY;
+	V[0xF] = 0;
+	NEXT();
+
+op_8xy5:
+	V[0xF] = (VX > VY) ? 1 : 0;
+	VX    -= VY;
+	NEXT();
+
+op_8xy6:
+	V[0xF] = VX & 0x1;
+	VX   >>= 1;
+	NEXT();
+
+op_8xy7:
+	V[0xF] = (VY > VX) ? 1 : 0;
+	VX     = VY - VX;
+	NEXT();
+
+op_8xyE:
+	V[0xF] = VX >> 7;
+	VX   <<= 1;
+	NEXT();
+
+op_9xy0:
+	cpu.pc += (VX != VY) ? 2 : 0;
+	NEXT();
+
+op_Annn:
+	cpu.I = NNN;
+	NEXT();
+
+op_Bnnn:
+	cpu.pc = NNN + V[0];
+	NEXT();
+
+op_Ex9E:
+	cpu.pc += cpu.key[VX] ? 2 : 0;
+	NEXT();
+
+op_ExA1:
+	cpu.pc += !cpu.key[VX] ? 2 : 0;
+	NEXT();
+
+op_Fx07:
+	VX = cpu.delay_timer;
+	NEXT();
+
+op_Fx15:
+	cpu.delay_timer = VX;
+	NEXT();
+
+op_Fx18:
+	cpu.sound_timer = VX;
+	NEXT();
+
+op_Fx1E:
+	cpu.I += VX;
+	NEXT();
+
+op_Fx29:
+	cpu.I = VX * 0x5;
+	NEXT();
+
+#undef NEXT
+#undef DISPATCH
+#undef VY
+#undef VX
+#undef KK
+#undef NNN
+#else
+	while (done < cycles && !cpu.fault && !cpu.waiting)
+	{
+		emulate_cycle();
+		++done;
+	}
+	return done;
+#endif
+}
@@ -0,0 +1,488 @@
+/**
+ * @file  Trace.cpp
+ * @brief Every executed instruction written to a file, compressed in the background
+ * @details
+ * The traced machine only appends records to a block in memory, a full block is handed to a
+ * thread which compresses and writes it. When the disk can not keep up, the machine waits
+ * for the writer once TRACE_PENDING blocks are queued instead of using more memory
+ */
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Trace.hpp"
+#include "Compress.hpp"
+#include "Delta.hpp"
+
+/*
+ * Size of the header of a block in the file
+ */
+#define TRACE_BLOCK_HEADER 28
+
+/*
+ * Longest wait of a record, longer ones are split so counts fit Byte_Reader::count
+ */
+#define TRACE_WAIT_MAX (1ul << 20)
+
+/*
+ * Records of a range of cycles, starting with a keyframe
+ */
+struct Trace_Block
+{
+	u64           first_cycle;
+	u64           cycles;
+	unsigned long size;
+	u8            data[TRACE_BLOCK_SIZE];
+};
+
+struct Trace_Queue
+{
+	/*
+	 * Only used by the writer thread until it is joined
+	 */
+	FILE            *file;
+	u64              offset;     /* Bytes written so far */
+	bool             failed;
+	std::vector<u64> index;      /* First cycle then offset of every block */
+	std::vector<u8>  packed;
+
+	/*
+	 * Shared, guarded by lock
+	 */
+	std::mutex                lock;
+	std::condition_variable   ready;      /* A block is pending or the trace is closing */
+	std::condition_variable   room;       /* A pending block was written */
+	std::deque<Trace_Block*>  pending;    /* The first one is being written */
+	std::vector<Trace_Block*> spare;
+	bool                      closing;
+
+	std::thread writer;
+};
+
+/**
+ * @brief Write a 64 bits number
+ */
+static void Write_Qword(Byte_Writer &out, u64 value)
+{
+	out.dword((u32)value);
+	out.dword((u32)(value >> 32));
+}
+
+/**
+ * @brief Write bytes to the file of the trace
+ */
+static void Write_File(Trace_Queue &queue, const u8 *data, unsigned long size)
+{
+	if (fwrite(data, 1, size, queue.file) != size){
+		queue.failed = true;
+	}
+	queue.offset += size;
+}
+
+/**
+ * @brief Compress a block and append it to the file, remembering its offset for the index
+ */
+static void Write_Block(Trace_Queue &queue, const Trace_Block &block)
+{
+	const unsigned long packed = Compress(block.data, block.size, queue.packed.data(), queue.packed.size());
+	if (!packed)
+	{
+		queue.failed = true;
+		return;
+	}
+
+	u8 header[TRACE_BLOCK_HEADER];
+	Byte_Writer out = { header, header + sizeof(header), true };
+	out.dword(0x42543843);    // "C8TB"
+	Write_Qword(out, block.first_cycle);
+	Write_Qword(out, block.cycles);
+	out.dword((u32)block.size);
+	out.dword((u32)packed);
+
+	queue.index.push_back(block.first_cycle);
+	queue.index.push_back(queue.offset);
+
+	Write_File(queue, header, sizeof(header));
+	Write_File(queue, queue.packed.data(), packed);
+}
+
+/**
+ * @brief Thread writing the blocks queued by Trace_Writer::flush until the trace is closed
+ */
+static void Write_Blocks(Trace_Queue *queue)
+{
+	std::unique_lock<std::mutex> guard(queue->lock);
+
+	for(;;)
+	{
+		queue->ready.wait(guard, [queue]{ return !queue->pending.empty() || queue->closing; });
+		if (queue->pending.empty())
+			return;
+
+		Trace_Block *block = queue->pending.front();
+		guard.unlock();
+		Write_Block(*queue, *block);
+		guard.lock();
+
+		queue->pending.pop_front();
+		queue->spare.push_back(block);
+		queue->room.notify_one();
+	}
+}
+
+Trace_Writer::Trace_Writer(void)
+{
+	cycle = 0;
+	block = nullptr;
+	at    = nullptr;
+	end   = nullptr;
+	queue = nullptr;
+}
+
+Trace_Writer::~Trace_Writer(void)
+{
+	close();
+}
+
+/**
+ * @brief Create a trace file starting with the current state of cpu
+ * @details The header keeps memory, keyframes only keep what instructions wrote since
+ * @param file_path file to create, replaced when it exists
+ * @param cpu       machine about to be traced
+ * @param image_id  hash of the rom it runs, see CHIP_8::image_id
+ * @return false when the file can not be created
+ */
+bool Trace_Writer::open(const char *file_path, const CPU &cpu, u32 image_id)
+{
+	close();
+
+	FILE *file = fopen(file_path, "wb");
+	if (!file)
+	{
+		std::cerr << "Can't create the trace " << file_path << std::endl;
+		return false;
+	}
+
+	memcpy(last.V, cpu.V, sizeof(last.V));
+	memcpy(last.stack, cpu.stack, sizeof(last.stack));
+	last.I           = cpu.I;
+	last.pc          = cpu.pc;
+	last.sp          = cpu.sp;
+	last.delay_timer = cpu.delay_timer;
+	last.sound_timer = cpu.sound_timer;
+
+	memcpy(memory, cpu.memory, MEMORY_SIZE);
+	memcpy(image, cpu.memory, MEMORY_SIZE);
+	cycle = 0;
+
+	queue = new Trace_Queue();
+	queue->file    = file;
+	queue->offset  = 0;
+	queue->failed  = false;
+	queue->closing = false;
+	queue->packed.resize(COMPRESS_BOUND(TRACE_BLOCK_SIZE));
+
+	u8 header[12];
+	Byte_Writer out = { header, header + sizeof(header), true };
+	out.dword(0x52543843);    // "C8TR"
+	out.dword(TRACE_VERSION);
+	out.dword(image_id);
+	Write_File(*queue, header, sizeof(header));
+	Write_File(*queue, image, MEMORY_SIZE);
+
+	queue->writer = std::thread(Write_Blocks, queue);
+
+	flush();
+	return true;
+}
+
+/**
+ * @brief Give the current block to the writer thread and start another one with a keyframe
+ * @details A block without any cycle is reused as it is
+ */
+void Trace_Writer::flush(void)
+{
+	{
+		std::unique_lock<std::mutex> guard(queue->lock);
+
+		if (block && cycle > block->first_cycle)
+		{
+			block->cycles = cycle - block->first_cycle;
+			block->size   = at - block->data;
+			queue->pending.push_back(block);
+			queue->ready.notify_one();
+			block = nullptr;
+		}
+
+		if (!block)
+		{
+			queue->room.wait(guard, [this]{ return queue->pending.size() < TRACE_PENDING; });
+			if (queue->spare.empty())
+			{
+				block = new Trace_Block();
+			}
+			else
+			{
+				block = queue->spare.back();
+				queue->spare.pop_back();
+			}
+		}
+	}
+
+	Byte_Writer out = { block->data, block->data + TRACE_BLOCK_SIZE, true };
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		out.byte(last.V[i]);
+	}
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		out.word(last.stack[i]);
+	}
+	out.word(last.I);
+	out.word(last.pc);
+	out.byte(last.sp);
+	out.byte(last.delay_timer);
+	out.byte(last.sound_timer);
+	Write_Delta(out, memory, image, MEMORY_SIZE);
+
+	block->first_cycle = cycle;
+	at  = out.at;
+	end = block->data + TRACE_BLOCK_SIZE;
+}
+
+/**
+ * @brief Write the last block and the index, then close the file
+ * @details The index is the first cycle and offset of every block, followed by their number,
+ * the offset of the index and "C8TE"
+ * @return false when the trace could not be entirely written
+ */
+bool Trace_Writer::close(void)
+{
+	if (!queue)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> guard(queue->lock);
+
+		if (cycle > block->first_cycle)
+		{
+			block->cycles = cycle - block->first_cycle;
+			block->size   = at - block->data;
+			queue->pending.push_back(block);
+		}
+		else
+		{
+			delete block;
+		}
+		block = nullptr;
+
+		queue->closing = true;
+		queue->ready.notify_one();
+	}
+	queue->writer.join();
+
+	const u64 index_offset = queue->offset;
+	const u32 count        = (u32)(queue->index.size() / 2);
+
+	std::vector<u8> index(queue->index.size() * 8 + 16);
+	Byte_Writer out = { index.data(), index.data() + index.size(), true };
+	for(u64 value : queue->index){
+		Write_Qword(out, value);
+	}
+	out.dword(count);
+	Write_Qword(out, index_offset);
+	out.dword(0x45543843);    // "C8TE"
+	Write_File(*queue, index.data(), index.size());
+
+	if (fclose(queue->file) != 0){
+		queue->failed = true;
+	}
+
+	const bool written = !queue->failed;
+	if (!written){
+		std::cerr << "The trace could not be entirely written" << std::endl;
+	}
+
+	for(Trace_Block *spare : queue->spare){
+		delete spare;
+	}
+	delete queue;
+	queue = nullptr;
+	at    = nullptr;
+	end   = nullptr;
+	return written;
+}
+
+/**
+ * @brief Append a 16 bits number to a record
+ */
+static inline void Put_Word(u8 *&at, u16 value)
+{
+	at[0] = value & 0xFF;
+	at[1] = value >> 8;
+	at   += 2;
+}
+
+/**
+ * @brief Record an instruction just executed at pc
+ * @details Only what differs from the registers after the previous record is written,
+ * most instructions change one register and take 2 or 4 bytes before compression.
+ * V is compared 8 registers at a time, and the record is written through a local pointer
+ * since stores of bytes could otherwise change any member as far as the compiler knows
+ * @param cpu    machine after the instruction
+ * @param pc     adress of the instruction
+ * @param opcode instruction executed
+ */
+void Trace_Writer::record(const CPU &cpu, u16 pc, u16 opcode)
+{
+	if (end - at < TRACE_RECORD_MAX){
+		flush();
+	}
+
+	u8 *const flags = at;
+	u8 *out = at + 1;
+	u8 set  = 0;
+
+	if (pc != last.pc)
+	{
+		set |= TRACE_PC;
+		Put_Word(out, pc);
+	}
+
+	// The reader fetches the opcode from its own memory unless it was written behind the trace
+	if (opcode != (memory[pc & (MEMORY_SIZE - 1)] << 8 | memory[(pc + 1) & (MEMORY_SIZE - 1)]))
+	{
+		set |= TRACE_OPCODE;
+		Put_Word(out, opcode);
+	}
+
+	u64 now[2], before[2];
+	memcpy(now, cpu.V, sizeof(now));
+	memcpy(before, last.V, sizeof(before));
+
+	if ((now[0] ^ before[0]) | (now[1] ^ before[1]))
+	{
+		u16 mask = 0;
+		for(unsigned half = 0; half < 2; ++half)
+		{
+			// One iteration per changed register
+			for(u64 changed = now[half] ^ before[half]; changed; )
+			{
+				const unsigned byte = __builtin_ctzll(changed) / 8;
+				mask    |= 1 << (half * 8 + byte);
+				changed &= ~(0xFFull << byte * 8);
+			}
+		}
+
+		set |= TRACE_V;
+		Put_Word(out, mask);
+		for(unsigned bits = mask; bits; bits &= bits - 1){
+			*out++ = cpu.V[__builtin_ctz(bits)];
+		}
+		memcpy(last.V, cpu.V, sizeof(last.V));
+	}
+
+	// I, sp and timers seldom change, they are compared at once
+	if (cpu.I != last.I || cpu.sp != last.sp || cpu.delay_timer != last.delay_timer || cpu.sound_timer != last.sound_timer)
+	{
+		if (cpu.I != last.I)
+		{
+			set |= TRACE_I;
+			Put_Word(out, cpu.I);
+			last.I = cpu.I;
+		}
+
+		if (cpu.sp != last.sp)
+		{
+			set |= TRACE_STACK;
+			*out++ = cpu.sp;
+
+			// A call pushed its return adress
+			if (cpu.sp > last.sp && cpu.sp <= NUMBER_REGISTER)
+			{
+				Put_Word(out, cpu.stack[cpu.sp - 1]);
+				last.stack[cpu.sp - 1] = cpu.stack[cpu.sp - 1];
+			}
+			last.sp = cpu.sp;
+		}
+
+		if (cpu.delay_timer != last.delay_timer || cpu.sound_timer != last.sound_timer)
+		{
+			set |= TRACE_TIMERS;
+			*out++ = cpu.delay_timer;
+			*out++ = cpu.sound_timer;
+			last.delay_timer = cpu.delay_timer;
+			last.sound_timer = cpu.sound_timer;
+		}
+	}
+
+	// Fx33 writes 3 bytes at I, Fx55 writes V0 to Vx
+	if ((opcode & 0xF000) == 0xF000 && cpu.I < MEMORY_SIZE)
+	{
+		unsigned length = 0;
+		if ((opcode & 0x00FF) == 0x33) length = 3;
+		if ((opcode & 0x00FF) == 0x55) length = ((opcode & 0x0F00) >> 8) + 1;
+		if (length > (unsigned)(MEMORY_SIZE - cpu.I)){
+			length = MEMORY_SIZE - cpu.I;
+		}
+
+		if (length)
+		{
+			set |= TRACE_MEMORY;
+			Put_Word(out, cpu.I);
+			*out++ = (u8)length;
+			memcpy(out, cpu.memory + cpu.I, length);
+			memcpy(memory + cpu.I, cpu.memory + cpu.I, length);
+			out += length;
+		}
+	}
+
+	*flags  = set;
+	at      = out;
+	last.pc = pc + 2;
+	++cycle;
+}
+
+/**
+ * @brief Record cycles spent waiting on Fx0A without executing anything
+ * @details Timers which ticked since the last record are written too, they may tick many
+ * times while nothing is executed
+ * @param cpu    machine waiting, its pc is the adress of Fx0A
+ * @param cycles number of cycles, nothing is written when it is 0
+ */
+void Trace_Writer::wait(const CPU &cpu, unsigned long cycles)
+{
+	const u16 pc = cpu.pc;
+
+	while (cycles)
+	{
+		if (end - at < TRACE_RECORD_MAX){
+			flush();
+		}
+
+		const unsigned long count = cycles < TRACE_WAIT_MAX ? cycles : TRACE_WAIT_MAX;
+
+		const bool moved = pc != last.pc;
+		const bool timed = cpu.delay_timer != last.delay_timer || cpu.sound_timer != last.sound_timer;
+
+		Byte_Writer out = { at, end, true };
+		out.byte(TRACE_WAIT | (moved ? TRACE_PC : 0) | (timed ? TRACE_TIMERS : 0));
+		if (moved){
+			out.word(pc);
+		}
+		if (timed)
+		{
+			out.byte(cpu.delay_timer);
+			out.byte(cpu.sound_timer);
+		}
+		out.count((unsigned)count);
+		at = out.at;
+
+		last.pc          = pc;
+		last.delay_timer = cpu.delay_timer;
+		last.sound_timer = cpu.sound_timer;
+		cycle  += count;
+		cycles -= count;
+	}
+}
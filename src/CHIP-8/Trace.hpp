@@ -0,0 +1,158 @@
+/**
+ * @file Trace.hpp
+ * @brief Every executed instruction written to a file, compressed in the background
+ * @see Trace.cpp
+ * @details
+ * A trace starts with a header: "C8TR", TRACE_VERSION, image_id of the rom and the memory
+ * of the machine when tracing started. Blocks follow, each one "C8TB", the first cycle, the
+ * number of cycles, the raw and compressed sizes, then the block compressed by Compress.
+ * A raw block is a keyframe followed by records. The keyframe is the state before its first
+ * cycle: the registers then a delta of memory against the header, see Delta.hpp.
+ * The file ends with an index of the cycle and offset of every block, its number of blocks,
+ * its offset and "C8TE". Numbers are little endian.
+ *
+ * A record is a byte of TRACE_ flags then, in order and only when their flag is set: pc,
+ * the opcode, a mask of the changed V then their values, I, sp then the return adress when
+ * sp grew, delay and sound timers, adress, length then bytes written in memory, the LEB128
+ * count of cycles spent waiting on Fx0A. Registers are the ones after the instruction, timers
+ * included since they tick between two instructions. The opcode is only written when it is
+ * not the one in memory as traced, an invalid opcode is a fault. The pc of a wait is the one
+ * of Fx0A, executed again by the next instruction.
+ * Only instructions are followed, a state restored while tracing shows as a jump.
+ */
+#ifndef TRACE_HPP
+#define TRACE_HPP
+#include "CPU/CPU.hpp"
+
+/*
+ * Version of the trace format, a trace of another version is refused
+ */
+#define TRACE_VERSION 1
+
+/*
+ * Bytes of records in a block before it is compressed
+ */
+#define TRACE_BLOCK_SIZE (256ul << 10)
+
+/*
+ * Blocks waiting for the writer before the traced machine waits too
+ */
+#define TRACE_PENDING 8
+
+/*
+ * Largest record, a block is written when less room is left
+ */
+#define TRACE_RECORD_MAX 64
+
+/*
+ * Size of the registers of a keyframe: V, stack, I, pc, sp and timers
+ */
+#define TRACE_REGISTERS_SIZE (NUMBER_REGISTER + NUMBER_REGISTER * 2 + 2 + 2 + 3)
+
+/*
+ * Largest keyframe, when all of memory differs from the header
+ */
+#define TRACE_KEYFRAME_MAX (TRACE_REGISTERS_SIZE + 2 * MEMORY_SIZE)
+
+/*
+ * Flags of a record
+ */
+#define TRACE_PC     0x01  /* pc is not the adress after the previous instruction */
+#define TRACE_V      0x02  /* Registers V changed */
+#define TRACE_I      0x04  /* I changed */
+#define TRACE_STACK  0x08  /* sp changed */
+#define TRACE_TIMERS 0x10  /* A timer changed */
+#define TRACE_MEMORY 0x20  /* Memory was written */
+#define TRACE_WAIT   0x40  /* Cycles spent waiting on Fx0A, no instruction */
+#define TRACE_OPCODE 0x80  /* The opcode is not the one in memory, it was written behind the trace */
+
+/*
+ * Registers a record is a delta of
+ */
+struct Trace_State
+{
+	u8  V[NUMBER_REGISTER];
+	u16 stack[NUMBER_REGISTER];
+	u16 I;
+	u16 pc;           /* Adress of the next instruction unless the record says otherwise */
+	u8  sp;
+	u8  delay_timer;
+	u8  sound_timer;
+};
+
+/*
+ * Blocks and writer thread, see Trace.cpp
+ */
+struct Trace_Queue;
+struct Trace_Block;
+
+struct Trace_Writer
+{
+	/*
+	 * Registers after the last record
+	 */
+	Trace_State last;
+
+	/*
+	 * Memory as written by the traced instructions, and when tracing started
+	 */
+	u8 memory[MEMORY_SIZE];
+	u8 image[MEMORY_SIZE];
+
+	/*
+	 * Cycles traced so far, waits included
+	 */
+	u64 cycle;
+
+	/*
+	 * Block being filled, from its keyframe to at
+	 */
+	Trace_Block *block;
+	u8          *at;
+	u8          *end;
+
+	/*
+	 * Blocks given to the writer thread, null when no trace is open
+	 */
+	Trace_Queue *queue;
+
+	Trace_Writer(void);
+	~Trace_Writer(void);
+
+	Trace_Writer(const Trace_Writer&) = delete;
+	Trace_Writer &operator=(const Trace_Writer&) = delete;
+
+	/**
+	 * @brief Create a trace file starting with the current state of cpu
+	 * @see   Trace.cpp
+	 * @return false when the file can not be created
+	 */
+	bool open(const char *file_path, const CPU &cpu, u32 image_id);
+
+	/**
+	 * @brief Write the last blocks and the index, then close the file
+	 * @see   Trace.cpp
+	 * @return false when the trace could not be entirely written
+	 */
+	bool close(void);
+
+	/**
+	 * @brief Record an instruction just executed at pc
+	 * @see   Trace.cpp
+	 */
+	void record(const CPU &cpu, u16 pc, u16 opcode);
+
+	/**
+	 * @brief Record cycles spent waiting on Fx0A without executing anything
+	 * @see   Trace.cpp
+	 */
+	void wait(const CPU &cpu, unsigned long cycles);
+
+	/**
+	 * @brief Give the current block to the writer thread and start another one
+	 * @see   Trace.cpp
+	 */
+	void flush(void);
+};
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file  Audio.cpp
+ * @brief Beeper sounding while the sound timer is not zero
+ * @details
+ * The emulation pushes every change of the beeper into a ring after each frame, the SDL
+ * callback pops them on the audio thread and fills its buffer with a square wave or silence.
+ * Neither side locks: the ring only has a head written by the emulation and a tail written by
+ * the callback. With AUDIO_SAMPLES samples per callback a change reaches the device within
+ * one callback and is heard within a second one, 5.3 ms at 48 kHz.
+ */
+#include <cstdio>
+#include "Audio.hpp"
+
+/**
+ * @brief Empty ring
+ */
+Audio_Ring::Audio_Ring(void) : head(0), tail(0)
+{
+}
+
+/**
+ * @brief Append an entry, called by the emulation only
+ * @details The entry is written before head is released, the callback never reads it early
+ * @param entry state of the beeper
+ * @return false when the ring is full, the callback is not running
+ */
+bool Audio_Ring::push(u8 entry)
+{
+	const unsigned at = head.load(std::memory_order_relaxed);
+	if (at - tail.load(std::memory_order_acquire) == AUDIO_RING_SIZE)
+		return false;
+
+	entries[at & (AUDIO_RING_SIZE - 1)] = entry;
+	head.store(at + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+ * @brief Take the oldest entry, called by the callback only
+ * @param entry receives the state of the beeper
+ * @return false when the ring is empty
+ */
+bool Audio_Ring::pop(u8 &entry)
+{
+	const unsigned at = tail.load(std::memory_order_relaxed);
+	if (at == head.load(std::memory_order_acquire))
+		return false;
+
+	entry = entries[at & (AUDIO_RING_SIZE - 1)];
+	tail.store(at + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+ * @brief Fill a buffer of the device, called by SDL on its audio thread
+ * @details
+ * Every change pushed since the previous callback is taken. A beep which started and ended
+ * in between still sounds during this buffer, the shortest beep of a rom is one frame
+ * @param userdata the Audio opening the device
+ * @param stream   samples to fill, signed 16 bits and mono
+ * @param len      size of stream in bytes
+ */
+static void SDLCALL Fill_Buffer(void *userdata, Uint8 *stream, int len)
+{
+	Audio &audio = *(Audio*)userdata;
+
+	bool heard = false;
+	u8 entry;
+	while (audio.ring.pop(entry))
+	{
+		audio.sounding = entry != 0;
+		heard |= audio.sounding;
+	}
+	heard |= audio.sounding;
+
+	Sint16 *samples = (Sint16*)stream;
+	const int count = len / (int)sizeof(Sint16);
+
+	if (!heard)
+	{
+		// The next beep starts on a rising edge
+		audio.phase = 0;
+		for(int i = 0; i < count; ++i){
+			samples[i] = 0;
+		}
+		return;
+	}
+
+	for(int i = 0; i < count; ++i)
+	{
+		samples[i] = audio.phase < audio.half_period ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+		if (++audio.phase == 2 * audio.half_period){
+			audio.phase = 0;
+		}
+	}
+}
+
+/**
+ * @brief Silent beeper, no device is opened
+ */
+Audio::Audio(void)
+{
+	device      = 0;
+	frequency   = AUDIO_FREQUENCY;
+	half_period = AUDIO_FREQUENCY / (2 * AUDIO_TONE);
+	beeping     = false;
+	sounding    = false;
+	phase       = 0;
+}
+
+/**
+ * @brief Close the device, the callback is not called anymore
+ */
+Audio::~Audio(void)
+{
+	if (device){
+		SDL_CloseAudioDevice(device);
+	}
+}
+
+/**
+ * @brief Open the default device and start its callback
+ * @details SDL must be initialized with its audio subsystem, see Init_GUI
+ * @return false when there is no sound, the emulation goes on silently
+ */
+bool Audio::open(void)
+{
+	SDL_AudioSpec wanted;
+	SDL_AudioSpec obtained;
+
+	SDL_zero(wanted);
+	wanted.freq     = AUDIO_FREQUENCY;
+	wanted.format   = AUDIO_S16SYS;
+	wanted.channels = 1;
+	wanted.samples  = AUDIO_SAMPLES;
+	wanted.callback = Fill_Buffer;
+	wanted.userdata = this;
+
+	// SDL converts to the device format, only the rate is taken as the device wants it
+	device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+	if (!device)
+	{
+		printf( "Audio could not be opened! SDL_Error: %s\n", SDL_GetError());
+		return false;
+	}
+
+	frequency   = obtained.freq;
+	half_period = frequency / (2 * AUDIO_TONE) > 0 ? frequency / (2 * AUDIO_TONE) : 1;
+
+	SDL_PauseAudioDevice(device, 0);
+	return true;
+}
+
+/**
+ * @brief Sound or silence the beeper from the next callback on
+ * @details
+ * Called after every frame, only changes are pushed. When the ring is full the change is
+ * pushed again after the next frame
+ * @param on true while the sound timer is not zero
+ */
+void Audio::beep(bool on)
+{
+	if (!device || on == beeping)
+		return;
+
+	if (ring.push(on ? 1 : 0)){
+		beeping = on;
+	}
+}
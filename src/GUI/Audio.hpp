@@ -0,0 +1,107 @@
+/**
+ * @file Audio.hpp
+ * @brief Beeper sounding while the sound timer is not zero
+ * @see Audio.cpp
+ */
+#ifndef AUDIO_HPP
+#define AUDIO_HPP
+#include <atomic>
+#include "../CHIP-8/CPU/CPU.hpp"
+#include <SDL.h>
+
+/*
+ * Samples per second asked to the device, it may choose another rate
+ */
+#define AUDIO_FREQUENCY 48000
+
+/*
+ * Samples per callback, 2.7 ms at 48 kHz: a change is heard within two callbacks
+ */
+#define AUDIO_SAMPLES 128
+
+/*
+ * Pitch and amplitude of the square wave
+ */
+#define AUDIO_TONE      440
+#define AUDIO_AMPLITUDE 3000
+
+/*
+ * Changes of the beeper not yet seen by the callback, a power of 2
+ */
+#define AUDIO_RING_SIZE 64
+
+/*
+ * Changes of the beeper from the emulation to the audio callback, one thread each side.
+ * Each index is only written by its side, neither waits for the other
+ */
+struct Audio_Ring
+{
+	u8 entries[AUDIO_RING_SIZE];
+
+	std::atomic<unsigned> head;   /* Next entry written by the emulation */
+	std::atomic<unsigned> tail;   /* Next entry read by the callback */
+
+	Audio_Ring(void);
+
+	/**
+	 * @brief Append an entry, called by the emulation only
+	 * @see   Audio.cpp
+	 * @return false when the ring is full
+	 */
+	bool push(u8 entry);
+
+	/**
+	 * @brief Take the oldest entry, called by the callback only
+	 * @see   Audio.cpp
+	 * @return false when the ring is empty
+	 */
+	bool pop(u8 &entry);
+};
+
+struct Audio
+{
+	/*
+	 * Device playing the beeper, 0 when there is no sound
+	 */
+	SDL_AudioDeviceID device;
+
+	/*
+	 * Samples per second and per half period of the tone, as opened
+	 */
+	int frequency;
+	int half_period;
+
+	/*
+	 * Beeper as last pushed by the emulation
+	 */
+	bool beeping;
+
+	/*
+	 * Owned by the callback: beeper as last popped and position in the period of the tone
+	 */
+	bool sounding;
+	int  phase;
+
+	Audio_Ring ring;
+
+	Audio(void);
+	~Audio(void);
+
+	Audio(const Audio&) = delete;
+	Audio &operator=(const Audio&) = delete;
+
+	/**
+	 * @brief Open the default device and start its callback
+	 * @see   Audio.cpp
+	 * @return false when there is no sound, the emulation goes on silently
+	 */
+	bool open(void);
+
+	/**
+	 * @brief Sound or silence the beeper from the next callback on
+	 * @see   Audio.cpp
+	 */
+	void beep(bool on);
+};
+
+#endif
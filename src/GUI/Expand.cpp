@@ -0,0 +1,164 @@
+/**
+ * @file  Expand.cpp
+ * @brief Expansion of packed framebuffer rows into ARGB8888 pixels
+ * @details
+ * Every pixel is off ^ ((off ^ on) & mask) where mask is all ones for a lit pixel, so the
+ * palette costs the same as black and white. Vector kernels broadcast bits of a row to every
+ * lane, keep the bit of each lane and compare it to build the masks, 16 pixels at a time with
+ * SSE2 and 32 with AVX2. AVX2 is chosen at startup when the processor has it
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EXPAND_SSE2
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EXPAND_AVX2
+#endif
+
+#include "Expand.hpp"
+
+/*
+ * Kernel expanding rows of the framebuffer
+ */
+typedef void (*Expander)(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels);
+
+/**
+ * @brief Expand one pixel at a time
+ */
+static void Expand_Scalar(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels)
+{
+	const u32 diff = palette.off ^ palette.on;
+
+	for(unsigned row = 0; row < count; ++row)
+	{
+		u64 line = rows[row];
+		for(unsigned column = 0; column < l; ++column)
+		{
+			u32 mask = 0u - (u32)((line >> (l - 1 - column)) & 1);
+			*pixels++ = palette.off ^ (diff & mask);
+		}
+	}
+}
+
+#ifdef EXPAND_SSE2
+/**
+ * @brief Expand 16 pixels at a time, 4 per vector
+ */
+static void Expand_SSE2(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels)
+{
+	const __m128i off  = _mm_set1_epi32((int)palette.off);
+	const __m128i diff = _mm_set1_epi32((int)(palette.off ^ palette.on));
+
+	// Bit of each lane for the 4 vectors of 16 pixels, the left pixel is the highest bit
+	const __m128i bit0 = _mm_setr_epi32(1 << 15, 1 << 14, 1 << 13, 1 << 12);
+	const __m128i bit1 = _mm_setr_epi32(1 << 11, 1 << 10, 1 << 9,  1 << 8);
+	const __m128i bit2 = _mm_setr_epi32(1 << 7,  1 << 6,  1 << 5,  1 << 4);
+	const __m128i bit3 = _mm_setr_epi32(1 << 3,  1 << 2,  1 << 1,  1 << 0);
+
+	for(unsigned row = 0; row < count; ++row)
+	{
+		u64 line = rows[row];
+		for(unsigned column = 0; column < l; column += 16, pixels += 16)
+		{
+			__m128i bits = _mm_set1_epi32((int)((line >> (l - 16 - column)) & 0xFFFF));
+			__m128i *out = (__m128i*)pixels;
+
+			_mm_storeu_si128(out + 0, _mm_xor_si128(off, _mm_and_si128(diff, _mm_cmpeq_epi32(_mm_and_si128(bits, bit0), bit0))));
+			_mm_storeu_si128(out + 1, _mm_xor_si128(off, _mm_and_si128(diff, _mm_cmpeq_epi32(_mm_and_si128(bits, bit1), bit1))));
+			_mm_storeu_si128(out + 2, _mm_xor_si128(off, _mm_and_si128(diff, _mm_cmpeq_epi32(_mm_and_si128(bits, bit2), bit2))));
+			_mm_storeu_si128(out + 3, _mm_xor_si128(off, _mm_and_si128(diff, _mm_cmpeq_epi32(_mm_and_si128(bits, bit3), bit3))));
+		}
+	}
+}
+#endif
+
+#ifdef EXPAND_AVX2
+/**
+ * @brief Expand 32 pixels at a time, 8 per vector
+ */
+__attribute__((target("avx2")))
+static void Expand_AVX2(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels)
+{
+	const __m256i off  = _mm256_set1_epi32((int)palette.off);
+	const __m256i diff = _mm256_set1_epi32((int)(palette.off ^ palette.on));
+
+	// Bit of each lane for the 4 vectors of 32 pixels, the left pixel is the highest bit
+	const __m256i bit0 = _mm256_setr_epi32(1u << 31, 1 << 30, 1 << 29, 1 << 28, 1 << 27, 1 << 26, 1 << 25, 1 << 24);
+	const __m256i bit1 = _mm256_setr_epi32(1 << 23,  1 << 22, 1 << 21, 1 << 20, 1 << 19, 1 << 18, 1 << 17, 1 << 16);
+	const __m256i bit2 = _mm256_setr_epi32(1 << 15,  1 << 14, 1 << 13, 1 << 12, 1 << 11, 1 << 10, 1 << 9,  1 << 8);
+	const __m256i bit3 = _mm256_setr_epi32(1 << 7,   1 << 6,  1 << 5,  1 << 4,  1 << 3,  1 << 2,  1 << 1,  1 << 0);
+
+	for(unsigned row = 0; row < count; ++row)
+	{
+		u64 line = rows[row];
+		for(unsigned column = 0; column < l; column += 32, pixels += 32)
+		{
+			__m256i bits = _mm256_set1_epi32((int)(u32)(line >> (l - 32 - column)));
+			__m256i *out = (__m256i*)pixels;
+
+			_mm256_storeu_si256(out + 0, _mm256_xor_si256(off, _mm256_and_si256(diff, _mm256_cmpeq_epi32(_mm256_and_si256(bits, bit0), bit0))));
+			_mm256_storeu_si256(out + 1, _mm256_xor_si256(off, _mm256_and_si256(diff, _mm256_cmpeq_epi32(_mm256_and_si256(bits, bit1), bit1))));
+			_mm256_storeu_si256(out + 2, _mm256_xor_si256(off, _mm256_and_si256(diff, _mm256_cmpeq_epi32(_mm256_and_si256(bits, bit2), bit2))));
+			_mm256_storeu_si256(out + 3, _mm256_xor_si256(off, _mm256_and_si256(diff, _mm256_cmpeq_epi32(_mm256_and_si256(bits, bit3), bit3))));
+		}
+	}
+}
+#endif
+
+/*
+ * Kernel chosen once at startup
+ */
+struct Expand_Kernel
+{
+	Expander    expand;
+	const char *name;
+
+	Expand_Kernel(void);
+};
+
+/**
+ * @brief Choose the widest kernel the processor supports
+ */
+Expand_Kernel::Expand_Kernel(void)
+{
+	expand = Expand_Scalar;
+	name   = "scalar";
+
+#ifdef EXPAND_SSE2
+	expand = Expand_SSE2;
+	name   = "sse2";
+#endif
+
+#ifdef EXPAND_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		expand = Expand_AVX2;
+		name   = "avx2";
+	}
+#endif
+}
+
+static const Expand_Kernel kernel;
+
+/**
+ * @brief Expand rows of the framebuffer into l pixels each with the chosen kernel
+ * @param rows    packed rows, bit 63 is the left pixel
+ * @param count   number of rows
+ * @param palette colours of unlit and lit pixels
+ * @param pixels  l * count pixels receiving the colours
+ */
+void Expand_Rows(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels)
+{
+	kernel.expand(rows, count, palette, pixels);
+}
+
+/**
+ * @brief Name of the kernel used by Expand_Rows
+ */
+const char *Expand_Name(void)
+{
+	return kernel.name;
+}
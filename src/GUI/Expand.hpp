@@ -0,0 +1,42 @@
+/**
+ * @file Expand.hpp
+ * @brief Expansion of packed framebuffer rows into ARGB8888 pixels
+ * @see Expand.cpp
+ */
+#ifndef EXPAND_HPP
+#define EXPAND_HPP
+#include "../CHIP-8/CPU/CPU.hpp"
+
+/*
+ * Colours of unlit and lit pixels, in ARGB8888
+ */
+struct Palette
+{
+	u32 off;
+	u32 on;
+};
+
+/*
+ * Black and white, the colours used when none is given
+ */
+#define PALETTE_OFF 0xFF000000
+#define PALETTE_ON  0xFFFFFFFF
+
+/**
+ * @brief Expand rows of the framebuffer into l pixels each
+ * @details Uses AVX2 or SSE2 when the host has them, a scalar loop otherwise
+ * @see   Expand.cpp
+ * @param rows    packed rows, bit 63 is the left pixel
+ * @param count   number of rows
+ * @param palette colours of unlit and lit pixels
+ * @param pixels  l * count pixels receiving the colours
+ */
+void Expand_Rows(const u64 *rows, unsigned count, const Palette &palette, u32 *pixels);
+
+/**
+ * @brief Name of the kernel used by Expand_Rows
+ * @see   Expand.cpp
+ */
+const char *Expand_Name(void);
+
+#endif
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "GUI.hpp"
 
 /*
@@ -90,8 +91,9 @@ SDL_Texture *Create_Texture(SDL_Renderer* renderer)
  * @brief Manipulation of keydown and keyup
  * @see main.cpp
  * @param chip8 which can modificate the value of key
+ * @param rewinding true while backspace is held, frames are then played backwards
  */
-void Manage_Events(CHIP_8 &chip8)
+void Manage_Events(CHIP_8 &chip8, bool &rewinding)
 {
 	SDL_Event e;
 	while (SDL_PollEvent(&e)) 
@@ -108,6 +110,10 @@ void Manage_Events(CHIP_8 &chip8)
 			if (e.key.keysym.sym == SDLK_ESCAPE){
 				exit(0);
 			}
+
+			if (e.key.keysym.sym == SDLK_BACKSPACE){
+				rewinding = true;
+			}
 			
 			for (unsigned i = 0; i < NUMBER_REGISTER; ++i) 
 			{
@@ -119,6 +125,10 @@ void Manage_Events(CHIP_8 &chip8)
 		// Process keyup events
 		if (e.type == SDL_KEYUP) 
 		{
+			if (e.key.keysym.sym == SDLK_BACKSPACE){
+				rewinding = false;
+			}
+
 			for (unsigned i = 0; i < NUMBER_REGISTER; ++i) 
 			{
 				if (e.key.keysym.sym == keymap[i]) {
@@ -130,21 +140,57 @@ void Manage_Events(CHIP_8 &chip8)
 }
 
 /**
- * @brief Redraw screen
+ * @brief Redraw rows which changed since the last present
+ * @details
+ * Dirty rows are compared with the rows presented last time, a sprite drawn then erased
+ * during the frame changes nothing so nothing is presented. Each run of changed rows is
+ * expanded and uploaded as one rectangle of the texture
  * @see main.cpp
- * @param chip8, pixels, texture, renderer
+ * @param chip8, palette, presented, pixels, texture, renderer
+ * @return true when the screen was presented
  */
-void Redraw_Screen(CHIP_8 &chip8,uint32_t* pixels,SDL_Texture *texture,SDL_Renderer *renderer)
+bool Redraw_Screen(CHIP_8 &chip8,const Palette &palette,u64 *presented,uint32_t* pixels,SDL_Texture *texture,SDL_Renderer *renderer)
 {
-	for (int i = 0; i < l*L; ++i) 
+	const u64 *gfx = chip8.cpu.gfx;
+	u32 changed = 0;
+
+	for (unsigned row = 0; row < L; ++row)
+	{
+		if ((chip8.cpu.dirty >> row & 1) && gfx[row] != presented[row]){
+			changed |= 1u << row;
+		}
+	}
+	chip8.cpu.dirty = 0;
+
+	if (!changed){
+		return false;
+	}
+
+	for (unsigned first = 0; first < L; )
 	{
-		uint8_t pixel = chip8.cpu.gfx[i];
-		pixels[i] = (0x00FFFFFF * pixel) | 0xFF000000;
+		if (!(changed >> first & 1))
+		{
+			++first;
+			continue;
+		}
+
+		unsigned count = 1;
+		while (first + count < L && (changed >> (first + count) & 1)){
+			++count;
+		}
+
+		// Expand packed rows into colours then update this part of the SDL texture
+		SDL_Rect rect = { 0, (int)first, l, (int)count };
+		Expand_Rows(gfx + first, count, palette, pixels + first * l);
+		SDL_UpdateTexture(texture, &rect, pixels + first * l, l * sizeof(Uint32));
+		memcpy(presented + first, gfx + first, count * sizeof(u64));
+
+		first += count;
 	}
-	// Update SDL texture
-	SDL_UpdateTexture(texture, NULL, pixels, l * sizeof(Uint32));
+
 	// Clear screen and render
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, NULL, NULL);
 	SDL_RenderPresent(renderer);
+	return true;
 }
@@ -1,6 +1,7 @@
 #ifndef GUI_HPP
 #define GUI_HPP
 #include "../CHIP-8/CHIP_8.hpp"
+#include "Expand.hpp"
 
 /*
  * We use SDL as GUI
@@ -52,14 +53,16 @@ SDL_Texture *Create_Texture(SDL_Renderer* renderer);
  * @brief Manipulation of keydown and keyup
  * @see GUI.cpp
  * @param chip8 which can modificate the value of key
+ * @param rewinding true while the rewind key is held
  */
-void Manage_Events(CHIP_8 &chip8);
+void Manage_Events(CHIP_8 &chip8, bool &rewinding);
 
 /**
- * @brief Redraw screen
+ * @brief Redraw rows which changed since the last present
  * @see GUI.cpp
- * @param chip8, pixels, texture, renderer
+ * @param chip8, palette, presented, pixels, texture, renderer
+ * @return true when the screen was presented
  */
-void Redraw_Screen(CHIP_8 &chip8,uint32_t *pixels,SDL_Texture *texture,SDL_Renderer *renderer);
+bool Redraw_Screen(CHIP_8 &chip8,const Palette &palette,u64 *presented,uint32_t *pixels,SDL_Texture *texture,SDL_Renderer *renderer);
 
 #endif
\ No newline at end of file
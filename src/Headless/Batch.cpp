@@ -0,0 +1,323 @@
+/**
+ * @file  Batch.cpp
+ * @brief Many independent machines run headless in one process
+ * @details
+ * Every worker owns a queue of tasks. It runs the task at the back of its queue for
+ * BATCH_SLICE_FRAMES frames then puts it back, and steals from the front of other queues
+ * when its own is empty, so long sessions spread over every core. A task is one instance, or
+ * up to LANES instances of a rom run in lockstep when their jobs ask for lanes. Machines share
+ * nothing, each one has its own random generator, and are only created when they first run
+ */
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "Batch.hpp"
+#include "Headless.hpp"
+#include "../CHIP-8/Lanes.hpp"
+
+/*
+ * Instances a worker runs together, a job alone or the jobs of lanes
+ */
+struct Batch_Task
+{
+	size_t        first;   /* First job, the others follow it */
+	unsigned      count;   /* Jobs, LANES at most */
+	CHIP_8       *chip8;   /* Machine of a job alone, created on its first slice */
+	Lanes        *lanes;   /* Lanes of the jobs, created on their first slice */
+	unsigned long frames;  /* Frames run by the lanes */
+};
+
+/*
+ * Tasks waiting for a worker
+ */
+struct Batch_Queue
+{
+	std::mutex          lock;
+	std::deque<size_t>  jobs;
+};
+
+/*
+ * State shared by the workers of a batch
+ */
+struct Batch_Pool
+{
+	const std::vector<Batch_Job> &jobs;
+	std::vector<Batch_Result>    &results;
+	std::vector<Batch_Task>       tasks;
+	std::deque<Batch_Queue>       queues;
+
+	Batch_Pool(const std::vector<Batch_Job> &jobs, std::vector<Batch_Result> &results, unsigned threads)
+		: jobs(jobs), results(results), queues(threads) {}
+};
+
+/**
+ * @brief Whether a job can run in the lanes of another one
+ */
+static bool Same_Lanes(const Batch_Job &job, const Batch_Job &other)
+{
+	return job.lanes && other.lanes && job.image == other.image && job.rom == other.rom &&
+	       job.frames == other.frames && job.cycles_per_frame == other.cycles_per_frame;
+}
+
+/**
+ * @brief Take the next task, from the back of its own queue or the front of another one
+ * @return false when every queue is empty
+ */
+static bool Take(Batch_Pool &pool, unsigned worker, size_t &job)
+{
+	const unsigned count = pool.queues.size();
+
+	for(unsigned i = 0; i < count; ++i)
+	{
+		Batch_Queue &queue = pool.queues[(worker + i) % count];
+		std::lock_guard<std::mutex> guard(queue.lock);
+
+		if (queue.jobs.empty())
+			continue;
+
+		if (i == 0)
+		{
+			job = queue.jobs.back();
+			queue.jobs.pop_back();
+		}
+		else
+		{
+			job = queue.jobs.front();
+			queue.jobs.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Run a slice of lanes, they are created on the first slice
+ * @details Lanes are only left out when they fault, each job ends after the frames of the first one
+ * @return true when every session of the lanes is over
+ */
+static bool Run_Lanes_Slice(Batch_Pool &pool, Batch_Task &task)
+{
+	const Batch_Job &settings = pool.jobs[task.first];
+	Lanes *&lanes             = task.lanes;
+
+	if (!lanes)
+	{
+		const Rom *rom = settings.image ? settings.image : Rom_Load(settings.rom.c_str());
+		if (!rom)
+			return true;
+
+		lanes = new Lanes();
+		lanes->cycles_per_frame = settings.cycles_per_frame;
+		lanes->load(*rom, task.count);
+
+		for(unsigned n = 0; n < task.count; ++n)
+		{
+			lanes->machine[n].engine = pool.jobs[task.first + n].engine;
+			lanes->machine[n].cpu.seed(pool.jobs[task.first + n].seed);
+			pool.results[task.first + n].loaded = true;
+		}
+	}
+
+	for(unsigned frame = 0; frame < BATCH_SLICE_FRAMES && task.frames < settings.frames && lanes->active; ++frame)
+	{
+		lanes->run_frame();
+		++task.frames;
+	}
+
+	for(unsigned n = 0; n < task.count; ++n)
+	{
+		pool.results[task.first + n].frames = lanes->frames[n];
+		pool.results[task.first + n].cycles = lanes->cycles[n];
+	}
+	return task.frames == settings.frames || !lanes->active;
+}
+
+/**
+ * @brief Run a slice of a task, its machines are created on the first slice
+ * @return true when the sessions are over
+ */
+static bool Run_Slice(Batch_Pool &pool, Batch_Task &task)
+{
+	if (pool.jobs[task.first].lanes){
+		return Run_Lanes_Slice(pool, task);
+	}
+
+	const Batch_Job &settings = pool.jobs[task.first];
+	Batch_Result &result      = pool.results[task.first];
+	CHIP_8 *&chip8            = task.chip8;
+
+	if (!chip8)
+	{
+		chip8 = new CHIP_8();
+		chip8->engine           = settings.engine;
+		chip8->cycles_per_frame = settings.cycles_per_frame;
+		chip8->cpu.seed(settings.seed);
+
+		if (settings.image)
+		{
+			chip8->load(*settings.image);
+			result.loaded = true;
+		}
+		else if (!(result.loaded = chip8->load(settings.rom.c_str())))
+			return true;
+	}
+
+	// Counted apart, results of neighbouring jobs share cache lines and run on other workers
+	unsigned long frames = result.frames;
+	unsigned long cycles = result.cycles;
+
+	for(unsigned frame = 0; frame < BATCH_SLICE_FRAMES && frames < settings.frames && !chip8->cpu.fault; ++frame)
+	{
+		cycles += chip8->run_frame();
+		++frames;
+	}
+
+	result.frames = frames;
+	result.cycles = cycles;
+	return frames == settings.frames || chip8->cpu.fault;
+}
+
+/**
+ * @brief Loop of a worker until every queue is empty
+ * @details
+ * Sessions are only put back in the queue of the worker running them, so once every queue is
+ * empty the last sessions are finished by their workers and the others stop
+ */
+static void Work(Batch_Pool &pool, unsigned worker)
+{
+	size_t index;
+
+	while (Take(pool, worker, index))
+	{
+		Batch_Task &task = pool.tasks[index];
+
+		if (!Run_Slice(pool, task))
+		{
+			Batch_Queue &queue = pool.queues[worker];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.jobs.push_back(index);
+			continue;
+		}
+
+		// Collect the results and free the machines
+		for(unsigned n = 0; n < task.count; ++n)
+		{
+			Batch_Result &result = pool.results[task.first + n];
+			if (!result.loaded)
+				continue;
+
+			const CHIP_8 &chip8 = task.lanes ? task.lanes->lane(n) : *task.chip8;
+			result.hash  = State_Hash(chip8);
+			result.fault = chip8.cpu.fault;
+		}
+		delete task.chip8;
+		delete task.lanes;
+		task.chip8 = nullptr;
+		task.lanes = nullptr;
+	}
+}
+
+/**
+ * @brief Run every job with a pool of threads which steal work from each other
+ * @param jobs    sessions to run
+ * @param results receives one result per job, in the order of jobs
+ * @param threads number of workers, 0 for one per core
+ */
+void Run_Batch(const std::vector<Batch_Job> &jobs, std::vector<Batch_Result> &results, unsigned threads)
+{
+	if (threads == 0){
+		threads = std::thread::hardware_concurrency();
+	}
+	if (threads == 0){
+		threads = 1;
+	}
+
+	results.assign(jobs.size(), Batch_Result{0, 0, 0, false, false});
+
+	Batch_Pool pool(jobs, results, threads);
+
+	// Jobs asking for lanes share them with the next jobs of the same rom
+	for(size_t job = 0; job < jobs.size(); )
+	{
+		Batch_Task task = { job, 1, nullptr, nullptr, 0 };
+		while (task.count < LANES && job + task.count < jobs.size() && Same_Lanes(jobs[job], jobs[job + task.count])){
+			++task.count;
+		}
+		pool.tasks.push_back(task);
+		job += task.count;
+	}
+
+	// Tasks are dealt like cards, stealing evens out the rest
+	for(size_t task = 0; task < pool.tasks.size(); ++task){
+		pool.queues[task % threads].jobs.push_back(task);
+	}
+
+	std::vector<std::thread> workers;
+	for(unsigned worker = 1; worker < threads; ++worker){
+		workers.emplace_back(Work, std::ref(pool), worker);
+	}
+	Work(pool, 0);
+
+	for(std::thread &worker : workers){
+		worker.join();
+	}
+}
+
+/**
+ * @brief Run instances of each rom, seeded one after the other from the seed of model, and print results
+ * @param names     names of the roms, printed with results
+ * @param roms      roms already read, one per name
+ * @param model     settings shared by every session
+ * @param instances sessions of each rom
+ * @param threads   number of workers, 0 for one per core
+ * @return exit code of the program, 2 when a rom could not be loaded
+ */
+int Batch_Command(const std::vector<const char*> &names, const std::vector<const Rom*> &roms, const Batch_Job &model,
+                  unsigned instances, unsigned threads)
+{
+	std::vector<Batch_Job> jobs;
+	std::vector<Batch_Result> results;
+
+	for(size_t r = 0; r < roms.size(); ++r)
+	{
+		for(unsigned i = 0; i < instances; ++i)
+		{
+			Batch_Job job = model;
+			job.rom   = names[r];
+			job.image = roms[r];
+			job.seed  = model.seed + i;
+			jobs.push_back(job);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Run_Batch(jobs, results, threads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	int code = 0;
+	unsigned long long cycles = 0;
+
+	printf("%-24s %10s %10s %12s %16s\n", "rom", "seed", "frames", "cycles", "state hash");
+	for(size_t i = 0; i < jobs.size(); ++i)
+	{
+		const Batch_Result &result = results[i];
+
+		if (!result.loaded)
+		{
+			printf("%-24s %10u not loaded\n", jobs[i].rom.c_str(), jobs[i].seed);
+			code = 2;
+			continue;
+		}
+		printf("%-24s %10u %10lu %12lu %.16llX%s\n", jobs[i].rom.c_str(), jobs[i].seed, result.frames,
+		       result.cycles, (unsigned long long)result.hash, result.fault ? " fault" : "");
+		cycles += result.cycles;
+	}
+
+	printf("Sessions     : %zu\n", jobs.size());
+	printf("Instructions : %llu\n", cycles);
+	printf("Time         : %.6f s\n", seconds);
+	printf("Speed        : %.0f instructions/s\n", seconds > 0 ? cycles / seconds : 0.0);
+	return code;
+}
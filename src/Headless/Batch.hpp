@@ -0,0 +1,60 @@
+/**
+ * @file Batch.hpp
+ * @brief Many independent machines run headless in one process
+ * @see Batch.cpp
+ */
+#ifndef BATCH_HPP
+#define BATCH_HPP
+#include <string>
+#include <vector>
+#include "../CHIP-8/CHIP_8.hpp"
+
+/*
+ * Frames a worker runs an instance before giving other instances a chance
+ */
+#define BATCH_SLICE_FRAMES 600
+
+/*
+ * Session to run, one machine each
+ */
+struct Batch_Job
+{
+	std::string   rom;               /* Name of the rom, its path unless image is given */
+	const Rom    *image;             /* Rom already read, or nullptr to load the file at rom */
+	u32           seed;              /* Seed of the random generator */
+	unsigned long frames;            /* Frames to run unless the CPU faults */
+	unsigned long cycles_per_frame;  /* Instructions per frame */
+	Engine        engine;
+	bool          lanes;             /* Run in lockstep with the next jobs of the same rom, see Lanes.hpp */
+};
+
+/*
+ * What a session produced
+ */
+struct Batch_Result
+{
+	u64           hash;    /* State_Hash of the machine at the end */
+	unsigned long frames;  /* Frames executed */
+	unsigned long cycles;  /* Instructions executed */
+	bool          loaded;  /* False when the rom could not be loaded */
+	bool          fault;   /* The CPU executed an invalid opcode */
+};
+
+/**
+ * @brief Run every job with a pool of threads which steal work from each other
+ * @see   Batch.cpp
+ * @param jobs    sessions to run
+ * @param results receives one result per job, in the order of jobs
+ * @param threads number of workers, 0 for one per core
+ */
+void Run_Batch(const std::vector<Batch_Job> &jobs, std::vector<Batch_Result> &results, unsigned threads);
+
+/**
+ * @brief Run instances of each rom, seeded one after the other from the seed of model, and print results
+ * @see   Batch.cpp
+ * @return exit code of the program, 2 when a rom could not be loaded
+ */
+int Batch_Command(const std::vector<const char*> &names, const std::vector<const Rom*> &roms, const Batch_Job &model,
+                  unsigned instances, unsigned threads);
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * @file  Headless.cpp
+ * @brief Execution of a rom without window, SDL is never used here
+ * @see   Headless.hpp
+ */
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "Headless.hpp"
+#include "../CHIP-8/Hash.hpp"
+#include "../CHIP-8/Movie.hpp"
+
+/**
+ * @brief Print the instructions of a run and how many were executed per second
+ * @details Skipped instructions are counted but not timed, see CHIP_8::skipped
+ */
+static void Print_Speed(unsigned long done, unsigned long skipped, double seconds)
+{
+	printf("Instructions : %lu\n", done);
+	printf("Skipped      : %lu, idle loops and waits for a key\n", skipped);
+	printf("Time         : %.6f s\n", seconds);
+	printf("Speed        : %.0f executed instructions/s\n", seconds > 0 ? (done - skipped) / seconds : 0.0);
+}
+
+/**
+ * @brief Run the loaded rom as fast as possible then report instructions per second
+ * @details
+ * Frames execute chip8.cycles_per_frame instructions then decrease timers, a number of
+ * cycles is executed as whole frames and a last partial one. No key is pressed
+ * @param chip8 machine with a rom loaded
+ * @param headless number of cycles or frames, and whether to dump the state
+ * @return exit code of the program, 3 when the CPU faulted
+ */
+int Run_Headless(CHIP_8 &chip8, const Headless &headless)
+{
+	unsigned long done    = 0;
+	unsigned long skipped = chip8.skipped;
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (headless.frames)
+	{
+		for(unsigned long frame = 0; frame < headless.frames && !chip8.cpu.fault; ++frame){
+			done += chip8.run_frame();
+		}
+	}
+	else
+	{
+		while (headless.cycles - done >= chip8.cycles_per_frame && !chip8.cpu.fault){
+			done += chip8.run_frame();
+		}
+		if (!chip8.cpu.fault){
+			done += chip8.run(headless.cycles - done);
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Engine       : %s\n", Engine_Name(chip8.engine));
+	Print_Speed(done, chip8.skipped - skipped, seconds);
+
+	if (headless.dump)
+		Dump_State(chip8);
+
+	return chip8.cpu.fault ? 3 : 0;
+}
+
+/**
+ * @brief Replay a movie from a frame as fast as possible then report instructions per second
+ * @details
+ * The machine is restored from the keyframe before from and runs the frames up to it, which
+ * is not timed. Keys of each frame are pressed as recorded, until the end of the movie or
+ * until headless.frames frames ran
+ * @param chip8    machine which loaded the rom of the movie
+ * @param movie    movie read from a file
+ * @param from     first frame to replay
+ * @param headless number of frames, zero for all of them, and whether to dump the state
+ * @return exit code of the program, 2 when the movie can not start there, 3 when the CPU faulted
+ */
+int Run_Movie(CHIP_8 &chip8, Movie &movie, u64 from, const Headless &headless)
+{
+	if (from > movie.length)
+	{
+		fprintf(stderr, "The movie has %llu frames\n", (unsigned long long)movie.length);
+		return 2;
+	}
+	if (!movie.seek(chip8, from))
+		return 2;
+
+	unsigned long frames  = 0;
+	unsigned long done    = 0;
+	unsigned long skipped = chip8.skipped;
+
+	auto start = std::chrono::steady_clock::now();
+
+	while ((!headless.frames || frames < headless.frames) && !chip8.cpu.fault && movie.play(chip8))
+	{
+		done += chip8.run_frame();
+		++frames;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Engine       : %s\n", Engine_Name(chip8.engine));
+	printf("Frames       : %llu to %llu of %llu\n", (unsigned long long)from, (unsigned long long)movie.frame, (unsigned long long)movie.length);
+	Print_Speed(done, chip8.skipped - skipped, seconds);
+
+	if (headless.dump)
+		Dump_State(chip8);
+
+	return chip8.cpu.fault ? 3 : 0;
+}
+
+/**
+ * @brief Hash of everything the program can observe: registers, timers, random generator,
+ * stack, memory and screen
+ * @param chip8 machine to hash
+ * @return 64 bits FNV-1a hash
+ */
+u64 State_Hash(const CHIP_8 &chip8)
+{
+	const CPU &cpu = chip8.cpu;
+	u64 hash = FNV_OFFSET;
+
+	hash = Hash(cpu.V, sizeof(cpu.V), hash);
+	hash = Hash(&cpu.I, sizeof(cpu.I), hash);
+	hash = Hash(&cpu.pc, sizeof(cpu.pc), hash);
+	hash = Hash(&cpu.sp, sizeof(cpu.sp), hash);
+	hash = Hash(cpu.stack, sizeof(cpu.stack), hash);
+	hash = Hash(&cpu.delay_timer, sizeof(cpu.delay_timer), hash);
+	hash = Hash(&cpu.sound_timer, sizeof(cpu.sound_timer), hash);
+	hash = Hash(&cpu.rng, sizeof(cpu.rng), hash);
+	hash = Hash(cpu.memory, sizeof(cpu.memory), hash);
+	return Hash(cpu.gfx, sizeof(cpu.gfx), hash);
+}
+
+/**
+ * @brief Print registers, timers, stack and hashes of framebuffer and memory
+ * @param chip8 machine to describe
+ */
+void Dump_State(const CHIP_8 &chip8)
+{
+	const CPU &cpu = chip8.cpu;
+
+	printf("PC=%.4X I=%.4X SP=%.2X DT=%.2X ST=%.2X RNG=%.8X",
+	       cpu.pc, cpu.I, cpu.sp, cpu.delay_timer, cpu.sound_timer, cpu.rng);
+	if (cpu.fault){
+		printf(" fault %.4X at %.3X", cpu.fault_opcode, cpu.fault_pc);
+	}
+	printf("\n");
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		printf("V%X=%.2X%c", i, cpu.V[i], i % 8 == 7 ? '\n' : ' ');
+	}
+
+	printf("Stack:");
+	for(unsigned i = 0; i < cpu.sp && i < NUMBER_REGISTER; ++i){
+		printf(" %.4X", cpu.stack[i]);
+	}
+	printf("\n");
+
+	printf("Framebuffer hash : %.16llX\n", (unsigned long long)Hash(cpu.gfx, sizeof(cpu.gfx)));
+	printf("Memory hash      : %.16llX\n", (unsigned long long)Hash(cpu.memory, sizeof(cpu.memory)));
+	printf("State hash       : %.16llX\n", (unsigned long long)State_Hash(chip8));
+}
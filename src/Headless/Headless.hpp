@@ -0,0 +1,63 @@
+/**
+ * @file Headless.hpp
+ * @brief Execution of a rom without window, for benchmarks and servers
+ * @see Headless.cpp
+ */
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+#include "../CHIP-8/CHIP_8.hpp"
+
+/*
+ * Keys of a session, see Movie.hpp
+ */
+struct Movie;
+
+/*
+ * What a headless run executes and reports
+ */
+struct Headless
+{
+	/*
+	 * Number of instructions to execute, used when frames is zero
+	 */
+	unsigned long cycles;
+
+	/*
+	 * Number of frames to execute, a movie is played to its end when it is zero
+	 */
+	unsigned long frames;
+
+	/*
+	 * Print the final state of the CPU and the hash of the framebuffer
+	 */
+	bool dump;
+};
+
+/**
+ * @brief Run the loaded rom as fast as possible then report instructions per second
+ * @see   Headless.cpp
+ * @return exit code of the program, 3 when the CPU faulted
+ */
+int Run_Headless(CHIP_8 &chip8, const Headless &headless);
+
+/**
+ * @brief Replay a movie from a frame as fast as possible then report instructions per second
+ * @see   Headless.cpp
+ * @return exit code of the program, 2 when the movie can not start there, 3 when the CPU faulted
+ */
+int Run_Movie(CHIP_8 &chip8, Movie &movie, u64 from, const Headless &headless);
+
+/**
+ * @brief Hash of everything the program can observe: registers, timers, random generator,
+ * stack, memory and screen
+ * @see   Headless.cpp
+ */
+u64 State_Hash(const CHIP_8 &chip8);
+
+/**
+ * @brief Print registers, timers, stack and hashes of framebuffer and memory
+ * @see   Headless.cpp
+ */
+void Dump_State(const CHIP_8 &chip8);
+
+#endif
@@ -2,18 +2,274 @@
  * @file main.cpp
  * @see inspired by https://github.com/JamesGriffin/CHIP-8-Emulator
  */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "GUI/Audio.hpp"
 #include "GUI/GUI.hpp"
+#include "CHIP-8/Rewind.hpp"
+#include "Headless/Headless.hpp"
+#include "Headless/Batch.hpp"
+#include "CHIP-8/Trace.hpp"
+#include "CHIP-8/Movie.hpp"
+
+/**
+ * @brief Print command usage
+ */
+static int Usage(void)
+{
+    std::cout << "Usage: chip8 [--engine interpreter|threaded|static] [--cycles-per-frame N] [--seed N] [--trace FILE] [--record MOVIE] [--palette RRGGBB:RRGGBB] <ROM file>|--rom NAME" << std::endl
+              << "       chip8 [--engine interpreter|threaded|static] [--cycles-per-frame N] [--seed N] [--trace FILE] --headless --cycles N|--frames N [--dump] <ROM file>|--rom NAME" << std::endl
+              << "       chip8 [--engine interpreter|threaded|static] [--trace FILE] --headless --play MOVIE [--from FRAME] [--frames N] [--dump] <ROM file>|--rom NAME" << std::endl
+              << "       chip8 [--engine interpreter|threaded|static] [--cycles-per-frame N] [--seed N] --batch INSTANCES [--lanes] [--threads N] --frames N <ROM file>|--rom NAME..." << std::endl
+              << "       --rom NAME runs a rom compiled into the emulator, named like the files of roms/" << std::endl
+              << "       --trace FILE records every executed instruction into FILE, read it with bin/trace.exe" << std::endl
+              << "       --lanes runs instances of a rom by 16 in lockstep, they share the instructions they agree on" << std::endl
+              << "       --record MOVIE writes the keys pressed in the window into MOVIE when it exits, --play MOVIE replays them" << std::endl;
+    return 1;
+}
+
+/**
+ * @brief Read a positive number given on the command line
+ * @return false when the text is not a number
+ */
+static bool Parse_Count(const char *text, unsigned long &count)
+{
+    char *end;
+
+    count = strtoul(text, &end, 10);
+    return *text != '\0' && *end == '\0' && count > 0;
+}
+
+/**
+ * @brief Read a frame number given on the command line, 0 included
+ * @return false when the text is not a number
+ */
+static bool Parse_Frame(const char *text, u64 &frame)
+{
+    char *end;
+
+    frame = strtoull(text, &end, 10);
+    return *text != '\0' && *text != '-' && *end == '\0';
+}
+
+/*
+ * Movie recorded from the window, and its file
+ */
+static Movie       recording;
+static const char *record_path = nullptr;
+
+/**
+ * @brief Write the movie being recorded when the process exits, the window exits it anywhere
+ */
+static void Write_Recording(void)
+{
+    recording.write(record_path);
+}
+
+/**
+ * @brief Read a seed of the random generator given on the command line, 0 included
+ * @return false when the text is not a 32 bits number
+ */
+static bool Parse_Seed(const char *text, u32 &seed)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    seed = (u32)value;
+    return *text != '\0' && *text != '-' && *end == '\0' && value <= 0xFFFFFFFFull;
+}
+
+/**
+ * @brief Read colours of unlit and lit pixels given as RRGGBB:RRGGBB
+ * @return false when the text is not a palette
+ */
+static bool Parse_Palette(const char *text, Palette &palette)
+{
+    char *end;
+
+    if (strlen(text) != 13 || text[6] != ':')
+        return false;
+
+    palette.off = 0xFF000000 | strtoul(text, &end, 16);
+    if (end != text + 6)
+        return false;
+
+    palette.on = 0xFF000000 | strtoul(text + 7, &end, 16);
+    return *end == '\0';
+}
 
 int main(int argc, char **argv)
 {
-	// Command usage
-    if (argc != 2) {
-        std::cout << "Usage: chip8 <ROM file>" << std::endl;
-        return 1;
+    CHIP_8 chip8;
+    std::vector<const char*> roms;
+    std::vector<bool> bundled;
+    bool headless = false;
+    bool lanes    = false;
+    unsigned long instances = 0;
+    unsigned long threads   = 0;
+    bool seeded = false;
+    u32 seed    = DEFAULT_SEED;
+    Headless options = {0, 0, false};
+    Palette palette  = {PALETTE_OFF, PALETTE_ON};
+    const char *trace_path = nullptr;
+    const char *play_path  = nullptr;
+    u64 from = 0;
+    bool from_given = false;
+
+    // Static so that the trace is completed when the window exits the process
+    static Trace_Writer tracer;
+
+	// Command line
+    for (int i = 1; i < argc; ++i)
+	{
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+		{
+            if (!Engine_From_Name(argv[++i], chip8.engine))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Count(argv[++i], options.cycles))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Count(argv[++i], options.frames))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--cycles-per-frame") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Count(argv[++i], chip8.cycles_per_frame))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Palette(argv[++i], palette))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Count(argv[++i], instances))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--lanes") == 0)
+            lanes = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Count(argv[++i], threads))
+                return Usage();
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Seed(argv[++i], seed))
+                return Usage();
+            seeded = true;
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+            play_path = argv[++i];
+        else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc)
+		{
+            if (!Parse_Frame(argv[++i], from))
+                return Usage();
+            from_given = true;
+        }
+        else if (strcmp(argv[i], "--dump") == 0)
+            options.dump = true;
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc)
+		{
+            roms.push_back(argv[++i]);
+            bundled.push_back(true);
+        }
+        else if (argv[i][0] != '-')
+		{
+            roms.push_back(argv[i]);
+            bundled.push_back(false);
+        }
+        else
+            return Usage();
+    }
+
+    if (instances) {
+        if (roms.empty() || headless || !options.frames || options.cycles || options.dump || trace_path || record_path || play_path) {
+            return Usage();
+        }
+    }
+    else if (lanes) {
+        return Usage();
+    }
+    else if (play_path) {
+        // Frames are optional, the movie ends by itself
+        if (roms.size() != 1 || !headless || options.cycles || record_path || seeded) {
+            return Usage();
+        }
+    }
+    else if (roms.size() != 1 || headless != (options.cycles || options.frames) || (options.cycles && options.frames) || (headless && record_path) || from_given) {
+        return Usage();
+    }
+
+	// Attempt to read ROMs, files once each and bundled ones without any file
+    std::vector<const Rom*> images;
+    for (size_t i = 0; i < roms.size(); ++i) {
+        const Rom *rom = bundled[i] ? Rom_Bundled(roms[i]) : Rom_Load(roms[i]);
+        if (!rom)
+            return 2;
+        images.push_back(rom);
+    }
+
+    // Many machines in this process, no window either
+    if (instances) {
+        Batch_Job model = { "", nullptr, seed, options.frames, chip8.cycles_per_frame, chip8.engine, lanes };
+        return Batch_Command(roms, images, model, instances, threads);
+    }
+
+    chip8.load(*images[0]);
+
+    // A movie brings its own seed and instructions per frame
+    Movie movie;
+    if (play_path) {
+        if (!movie.read(play_path))
+            return 2;
+        seeded = true;
+        seed   = movie.seed;
+        chip8.cycles_per_frame = movie.cycles_per_frame;
+    }
+
+    // Headless runs are reproducible, a window plays a new game each time unless asked
+    if (!headless && !seeded) {
+        seed = (u32)time(NULL);
+    }
+    chip8.cpu.seed(seed);
+
+    // Traced from the first instruction
+    if (trace_path) {
+        if (!tracer.open(trace_path, chip8.cpu, chip8.image_id))
+            return 2;
+        chip8.trace = &tracer;
+    }
+
+    // Without window, SDL is never initialized
+    if (play_path) {
+        return Run_Movie(chip8, movie, from, options);
+    }
+    if (headless) {
+        return Run_Headless(chip8, options);
+    }
+
+    // Keys are recorded from the first frame, written whichever way the window exits
+    if (record_path) {
+        recording.start(chip8, seed);
+        atexit(Write_Recording);
     }
 
-    CHIP_8 chip8 = CHIP_8();
-	
 	Init_GUI();
    
     SDL_Window* window = Create_Window();
@@ -25,30 +281,93 @@ int main(int argc, char **argv)
     // Create texture that stores frame buffer
     SDL_Texture* sdlTexture = Create_Texture(renderer);
 
+    // Beeper of the sound timer, silent when there is no audio device
+    Audio audio;
+    audio.open();
+
     // Temporary pixel buffer
     uint32_t pixels[l*L];
+
+    // Rows shown by the last present, all different at first so the whole screen is drawn
+    u64 presented[L];
+    for (unsigned row = 0; row < L; ++row) {
+        presented[row] = ~chip8.cpu.gfx[row];
+    }
 	
-	// Attempt to load ROM
-    if (!chip8.load(argv[1]))
-        return 2;
-		
-	
-    // Emulation loop
-    for(;;) {
-        chip8.emulate_cycle();
+    // Frames are scheduled on the high resolution counter
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    const Uint64 period    = frequency / FRAME_RATE;
+    Uint64 deadline        = SDL_GetPerformanceCounter();
+
+    // Every frame is recorded, holding the rewind key plays them backwards
+    Rewind history;
+    bool rewinding = false;
 
+    // Set when the frame only waited for a key or went round an idle loop, timers stopped before and after it
+    bool asleep = false;
+
+    // Emulation loop, one iteration per frame
+    for(;;) {
         // Process SDL events
-        Manage_Events(chip8);
+        Manage_Events(chip8, rewinding);
 
-        // If draw occurred, redraw SDL screen
-        if (chip8.drawFlag) 
+        // A movie only goes forward, frames played backwards can not be replayed
+        if (record_path) {
+            rewinding = false;
+        }
+
+        if (rewinding) {
+            // The oldest frame stays on screen once history is exhausted
+            history.step_back(chip8);
+        }
+        else {
+            // A frame read by the program with a timer running is not idle, it may see it reach zero
+            const bool stopped = !chip8.cpu.delay_timer && !chip8.cpu.sound_timer;
+
+            if (record_path) {
+                recording.record(chip8);
+            }
+            chip8.run_frame();
+
+            // Stop on invalid instruction
+            if (chip8.cpu.fault)
+            {
+                fprintf(stderr, "\nUnknown op code: %.4X at %.3X\n", chip8.cpu.fault_opcode, chip8.cpu.fault_pc);
+                return 3;
+            }
+
+            history.record(chip8);
+
+            // Timers stopped for the whole frame, Fx15 or Fx18 may have started them before a wait
+            asleep = stopped && !chip8.cpu.delay_timer && !chip8.cpu.sound_timer &&
+                     (chip8.idle || chip8.waiting_key());
+        }
+
+        // Heard within a few milliseconds, frames played backwards are silent
+        audio.beep(!rewinding && chip8.cpu.sound_timer > 0);
+
+        // If rows were drawn, redraw the ones which changed
+        if (chip8.cpu.dirty) 
 		{
-            chip8.drawFlag = false;
-			Redraw_Screen(chip8,pixels,sdlTexture,renderer);
+			Redraw_Screen(chip8,palette,presented,pixels,sdlTexture,renderer);
         }
 
-		SDL_Delay(5);
+        // Nothing changes before an event comes
+        if (!rewinding && asleep) {
+            SDL_WaitEvent(nullptr);
+            deadline = SDL_GetPerformanceCounter();
+            continue;
+        }
 
+        // Sleep the rest of the frame, a late frame starts the next one at once
+        deadline += period;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now < deadline) {
+            SDL_Delay((Uint32)((deadline - now) * 1000 / frequency));
+        }
+        else {
+            deadline = now;
+        }
     }
 	SDL_Quit();
 	free(window);
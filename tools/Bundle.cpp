@@ -0,0 +1,118 @@
+/**
+ * @file  Bundle.cpp
+ * @brief Generator of the roms compiled into the emulator
+ * @details
+ * Every file of a directory becomes a constexpr array of bytes with its name, size and hash,
+ * written as a header included by src/CHIP-8/Bundle.cpp. Files which do not fit in memory
+ * are left out. The Makefile runs it before building, so the bundle follows roms/
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../src/CHIP-8/Hash.hpp"
+#include "../src/CHIP-8/Rom.hpp"
+
+/**
+ * @brief Write a file name for a C++ string literal or comment
+ * @details Bytes other than letters, digits, spaces, dots, dashes and underscores become octal escapes
+ */
+static void Write_Name(FILE *out, const std::string &name)
+{
+	for(unsigned char c : name)
+	{
+		if (isalnum(c) || c == ' ' || c == '.' || c == '-' || c == '_')
+			fputc(c, out);
+		else
+			fprintf(out, "\\%.3o", c);
+	}
+}
+
+/**
+ * @brief Print command usage
+ */
+static int Usage(void)
+{
+	printf("Usage: bundle <roms directory> <output header>\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3)
+		return Usage();
+
+	// Roms sorted by name so the header only changes with the roms
+	std::vector<std::filesystem::path> paths;
+	std::error_code error;
+
+	for(const auto &entry : std::filesystem::directory_iterator(argv[1], error))
+	{
+		if (entry.is_regular_file()){
+			paths.push_back(entry.path());
+		}
+	}
+	if (error)
+	{
+		fprintf(stderr, "Failed to read %s\n", argv[1]);
+		return 2;
+	}
+	std::sort(paths.begin(), paths.end());
+
+	FILE *out = fopen(argv[2], "w");
+	if (!out)
+	{
+		fprintf(stderr, "Failed to write %s\n", argv[2]);
+		return 2;
+	}
+
+	fprintf(out, "/*\n * Generated by tools/Bundle.cpp from %s, do not edit\n */\n", argv[1]);
+
+	std::vector<std::string> names;
+	std::vector<u64>         hashes;
+	std::vector<size_t>      sizes;
+
+	for(const auto &path : paths)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		if (data.empty() || data.size() > ROM_MAX_SIZE)
+		{
+			fprintf(stderr, "Skipping %s, it is empty or does not fit in memory\n", path.string().c_str());
+			continue;
+		}
+
+		fprintf(out, "\nstatic constexpr const u8 bundle_data_%zu[] =\n{", names.size());
+		for(size_t i = 0; i < data.size(); ++i){
+			fprintf(out, "%s0x%.2X,", i % 16 ? " " : "\n\t", data[i]);
+		}
+		fprintf(out, "\n};\n");
+
+		names.push_back(path.filename().string());
+		hashes.push_back(Hash(data.data(), data.size()));
+		sizes.push_back(data.size());
+	}
+
+	// The last entry marks the end, the table is never empty
+	fprintf(out, "\nstatic constexpr const Bundled_Rom bundled_roms[] =\n{\n");
+	for(size_t i = 0; i < names.size(); ++i)
+	{
+		fprintf(out, "\t{ \"");
+		Write_Name(out, names[i]);
+		fprintf(out, "\", %zu, 0x%.16llXULL, bundle_data_%zu },\n", sizes[i], (unsigned long long)hashes[i], i);
+	}
+	fprintf(out, "\t{ nullptr, 0, 0, nullptr }\n};\n");
+
+	if (fclose(out) != 0)
+	{
+		fprintf(stderr, "Failed to write %s\n", argv[2]);
+		return 2;
+	}
+	printf("Bundled %zu roms into %s\n", names.size(), argv[2]);
+	return 0;
+}
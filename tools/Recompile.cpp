@@ -0,0 +1,611 @@
+/**
+ * @file  Recompile.cpp
+ * @brief Static recompiler of the roms of directories into C++
+ * @details
+ * The instructions reachable from START_ADRESS are found by following jumps, calls, returns
+ * after calls and both sides of skips, at even or odd adresses. Those following each other
+ * are cut into blocks, each one becoming a function of a header included by
+ * src/CHIP-8/Static/Static.cpp. Jumps, calls and skips inside a block are gotos, other ones
+ * return to the engine. Targets of Bnnn and invalid opcodes are left to the interpreter. A
+ * block returns after Fx33 and Fx55 too, the only instructions writing memory, so that code
+ * they modify is never run compiled. The Makefile runs it before building, so the blocks
+ * follow roms/ and the probes of bench/probes/
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../src/CHIP-8/Hash.hpp"
+#include "../src/CHIP-8/Rom.hpp"
+#include "../src/CHIP-8/Disassembler.hpp"
+#include "../src/CHIP-8/Static/Static.hpp"
+
+/*
+ * Way an instruction goes on
+ */
+enum Kind
+{
+	KIND_INVALID,   // interpreted, it faults
+	KIND_BODY,      // keeps going with the next one
+	KIND_END        // branches or sets pc
+};
+
+/**
+ * @brief Way an instruction goes on
+ */
+static Kind Classify(u16 opcode)
+{
+	switch (opcode & 0xF000)
+	{
+		case 0x0000:
+			if ((opcode & 0x000F) == 0x0) return KIND_BODY;
+			if ((opcode & 0x000F) == 0xE) return KIND_END;
+			return KIND_INVALID;
+
+		case 0x8000:
+			return ((opcode & 0x000F) <= 0x7 || (opcode & 0x000F) == 0xE) ? KIND_BODY : KIND_INVALID;
+
+		case 0x6000:
+		case 0x7000:
+		case 0xA000:
+		case 0xC000:
+		case 0xD000:
+			return KIND_BODY;
+
+		case 0xE000:
+			return ((opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1) ? KIND_END : KIND_INVALID;
+
+		case 0xF000:
+			switch (opcode & 0x00FF)
+			{
+				case 0x07:
+				case 0x15:
+				case 0x18:
+				case 0x1E:
+				case 0x29:
+				case 0x65:
+					return KIND_BODY;
+				case 0x0A:
+				case 0x33:
+				case 0x55:
+					return KIND_END;
+				default:
+					return KIND_INVALID;
+			}
+
+		default:
+			// 1nnn, 2nnn, 3xkk, 4xkk, 5xyn, 9xyn, Bnnn
+			return KIND_END;
+	}
+}
+
+/*
+ * Rom being recompiled
+ */
+struct Program
+{
+	std::vector<u8> data;
+	u16 end;                          /* Adress after the rom */
+	bool reached[MEMORY_SIZE];        /* Instruction executed on some path */
+	bool compiled[MEMORY_SIZE];       /* Instruction already put in a block */
+
+	/**
+	 * @brief Opcode at an adress of the rom
+	 */
+	u16 opcode(u16 adress) const {
+		return data[adress - START_ADRESS] << 8 | data[adress - START_ADRESS + 1];
+	}
+
+	/**
+	 * @brief Whether a whole instruction of the rom is at an adress, odd ones included
+	 */
+	bool inside(unsigned adress) const {
+		return adress >= START_ADRESS && adress + 1 < end;
+	}
+};
+
+/*
+ * Instructions of the function being written
+ */
+struct Block
+{
+	unsigned adress;
+	unsigned length;
+	bool     label[STATIC_BLOCK_LENGTH];   /* Instruction a goto goes to */
+
+	/**
+	 * @brief Whether an instruction of the block is at an adress
+	 */
+	bool holds(unsigned target) const {
+		return target >= adress && target < adress + 2 * length && !((target - adress) & 1);
+	}
+};
+
+/**
+ * @brief Mark the instructions reachable from START_ADRESS
+ */
+static void Explore(Program &program)
+{
+	std::vector<unsigned> pending = { START_ADRESS };
+
+	auto branch = [&](unsigned target){
+		if (program.inside(target)){
+			pending.push_back(target);
+		}
+	};
+
+	while (!pending.empty())
+	{
+		unsigned adress = pending.back();
+		pending.pop_back();
+
+		while (program.inside(adress) && !program.reached[adress])
+		{
+			const u16  opcode = program.opcode(adress);
+			const Kind kind   = Classify(opcode);
+
+			if (kind == KIND_INVALID)
+				break;
+
+			program.reached[adress] = true;
+			if (kind == KIND_BODY)
+			{
+				adress += 2;
+				continue;
+			}
+
+			switch (opcode & 0xF000)
+			{
+				case 0x1000:
+					branch(opcode & 0x0FFF);
+					break;
+
+				case 0x2000:
+					branch(opcode & 0x0FFF);
+					branch(adress + 2);
+					break;
+
+				case 0x3000:
+				case 0x4000:
+				case 0x5000:
+				case 0x9000:
+				case 0xE000:
+					branch(adress + 2);
+					branch(adress + 4);
+					break;
+
+				case 0xF000:
+					// Fx0A, Fx33 and Fx55 go on after themselves
+					branch(adress + 2);
+					break;
+
+				default:
+					// 00EE comes back after a call, Bnnn is interpreted
+					break;
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Adresses an instruction goes on at without returning to the engine
+ * @details They are gotos when the block holds them
+ * @return number of adresses in targets
+ */
+static unsigned Successors(u16 adress, u16 opcode, unsigned targets[2])
+{
+	if (Classify(opcode) == KIND_BODY)
+	{
+		targets[0] = adress + 2;
+		return 1;
+	}
+
+	switch (opcode & 0xF000)
+	{
+		case 0x1000:
+		case 0x2000:
+			targets[0] = opcode & 0x0FFF;
+			return 1;
+
+		case 0x3000:
+		case 0x4000:
+		case 0x5000:
+		case 0x9000:
+		case 0xE000:
+			targets[0] = adress + 4;
+			targets[1] = adress + 2;
+			return 2;
+
+		default:
+			// 00EE, Bnnn and Fx0A set pc, Fx33 and Fx55 have their writes checked
+			return 0;
+	}
+}
+
+/**
+ * @brief Write the statement going on at an adress, a goto when the block holds it
+ */
+static void Emit_Go(FILE *out, const Block &block, unsigned target, const char *indent)
+{
+	if (block.holds(target)){
+		fprintf(out, "%sSTATIC_GO(0x%.3X, a_%.3X);\n", indent, target, target);
+	}
+	else{
+		fprintf(out, "%sSTATIC_LEAVE(0x%.3X);\n", indent, target);
+	}
+}
+
+/**
+ * @brief Write the statements executing an instruction of a block and going on after it
+ * @details The macros ending an instruction are defined by Static.cpp
+ */
+static void Emit_Instruction(FILE *out, const Block &block, u16 adress, u16 opcode)
+{
+	const unsigned x   = (opcode & 0x0F00) >> 8;
+	const unsigned y   = (opcode & 0x00F0) >> 4;
+	const unsigned n   = opcode & 0x000F;
+	const unsigned kk  = opcode & 0x00FF;
+	const unsigned nnn = opcode & 0x0FFF;
+	const unsigned next = adress + 2;
+	const unsigned skip = adress + 4;
+
+	// Condition of a skip
+	char condition[64];
+
+	switch (opcode & 0xF000)
+	{
+		case 0x0000:
+			if (n == 0x0)
+			{
+				fprintf(out, "\t\tmemset(cpu.gfx, 0, sizeof(cpu.gfx));\n\t\tcpu.dirty = ~0u;\n");
+				Emit_Go(out, block, next, "\t\t");
+			}
+			else{
+				// An empty stack faults like CPU::OP_00EE, pc stays on the instruction
+				fprintf(out, "\t\tif (cpu.sp == 0){\n\t\t\tcpu.raise_fault(0x%.3X, 0x%.4X);\n\t\t\tSTATIC_LEAVE(0x%.3X);\n\t\t}\n", adress, opcode, adress);
+				fprintf(out, "\t\tcpu.sp--;\n\t\tcpu.pc = cpu.stack[cpu.sp];\n\t\tSTATIC_END();\n");
+			}
+			return;
+
+		case 0x1000:
+			Emit_Go(out, block, nnn, "\t\t");
+			return;
+
+		case 0x2000:
+			// A full stack faults like CPU::OP_2nnn, pc stays on the instruction
+			fprintf(out, "\t\tif (cpu.sp >= NUMBER_REGISTER){\n\t\t\tcpu.raise_fault(0x%.3X, 0x%.4X);\n\t\t\tSTATIC_LEAVE(0x%.3X);\n\t\t}\n", adress, opcode, adress);
+			fprintf(out, "\t\tcpu.stack[cpu.sp] = 0x%.3X;\n\t\t++cpu.sp;\n", next);
+			Emit_Go(out, block, nnn, "\t\t");
+			return;
+
+		case 0x3000:
+			snprintf(condition, sizeof(condition), "cpu.V[0x%X] == 0x%.2X", x, kk);
+			break;
+
+		case 0x4000:
+			snprintf(condition, sizeof(condition), "cpu.V[0x%X] != 0x%.2X", x, kk);
+			break;
+
+		case 0x5000:
+			snprintf(condition, sizeof(condition), "cpu.V[0x%X] == cpu.V[0x%X]", x, y);
+			break;
+
+		case 0x6000:
+			fprintf(out, "\t\tcpu.V[0x%X] = 0x%.2X;\n", x, kk);
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0x7000:
+			fprintf(out, "\t\tcpu.V[0x%X] += 0x%.2X;\n", x, kk);
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0x8000:
+			switch (n)
+			{
+				case 0x0: fprintf(out, "\t\tcpu.V[0x%X] = cpu.V[0x%X];\n", x, y);  break;
+				case 0x1: fprintf(out, "\t\tcpu.V[0x%X] |= cpu.V[0x%X];\n", x, y); break;
+				case 0x2: fprintf(out, "\t\tcpu.V[0x%X] &= cpu.V[0x%X];\n", x, y); break;
+				case 0x3: fprintf(out, "\t\tcpu.V[0x%X] ^= cpu.V[0x%X];\n", x, y); break;
+
+				// VF is cleared whatever the sum, as CPU::OP_8xy4 does
+				case 0x4: fprintf(out, "\t\tcpu.V[0x%X] += cpu.V[0x%X];\n\t\tcpu.V[0xF] = 0;\n", x, y); break;
+
+				case 0x5:
+					fprintf(out, "\t\tcpu.V[0xF] = cpu.V[0x%X] > cpu.V[0x%X] ? 1 : 0;\n\t\tcpu.V[0x%X] -= cpu.V[0x%X];\n", x, y, x, y);
+					break;
+				case 0x6:
+					fprintf(out, "\t\tcpu.V[0xF] = cpu.V[0x%X] & 0x1;\n\t\tcpu.V[0x%X] >>= 1;\n", x, x);
+					break;
+				case 0x7:
+					fprintf(out, "\t\tcpu.V[0xF] = cpu.V[0x%X] > cpu.V[0x%X] ? 1 : 0;\n\t\tcpu.V[0x%X] = cpu.V[0x%X] - cpu.V[0x%X];\n", y, x, x, y, x);
+					break;
+				default:
+					fprintf(out, "\t\tcpu.V[0xF] = cpu.V[0x%X] >> 7;\n\t\tcpu.V[0x%X] <<= 1;\n", x, x);
+					break;
+			}
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0x9000:
+			snprintf(condition, sizeof(condition), "cpu.V[0x%X] != cpu.V[0x%X]", x, y);
+			break;
+
+		case 0xA000:
+			fprintf(out, "\t\tcpu.I = 0x%.3X;\n", nnn);
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0xB000:
+			fprintf(out, "\t\tcpu.pc = 0x%.3X + cpu.V[0x0];\n\t\tSTATIC_END();\n", nnn);
+			return;
+
+		case 0xC000:
+			fprintf(out, "\t\tcpu.V[0x%X] = cpu.random() & 0x%.2X;\n", x, kk);
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0xD000:
+			fprintf(out, "\t\tcpu.V[0xF] = cpu.draw(cpu.V[0x%X], cpu.V[0x%X], cpu.I, %u);\n", x, y, n);
+			Emit_Go(out, block, next, "\t\t");
+			return;
+
+		case 0xE000:
+			snprintf(condition, sizeof(condition), "%scpu.key[cpu.V[0x%X]]", kk == 0x9E ? "" : "!", x);
+			break;
+
+		default:
+			switch (kk)
+			{
+				case 0x07: fprintf(out, "\t\tcpu.V[0x%X] = cpu.delay_timer;\n", x); break;
+				case 0x15: fprintf(out, "\t\tcpu.delay_timer = cpu.V[0x%X];\n", x); break;
+				case 0x18: fprintf(out, "\t\tcpu.sound_timer = cpu.V[0x%X];\n", x); break;
+				case 0x1E: fprintf(out, "\t\tcpu.I += cpu.V[0x%X];\n", x);          break;
+				case 0x29: fprintf(out, "\t\tcpu.I = cpu.V[0x%X] * 0x5;\n", x);     break;
+
+				case 0x0A:
+					// The last key pressed wins, pc stays on Fx0A while none is
+					fprintf(out, "\t\tcpu.pc = 0x%.3X;\n", adress);
+					fprintf(out, "\t\tfor(unsigned i = 0; i < NUMBER_REGISTER; ++i)\n\t\t{\n");
+					fprintf(out, "\t\t\tif (cpu.key[i] != 0)\n\t\t\t{\n\t\t\t\tcpu.V[0x%X] = i;\n\t\t\t\tcpu.pc = 0x%.3X;\n\t\t\t}\n\t\t}\n", x, next);
+					fprintf(out, "\t\tif (cpu.pc == 0x%.3X){\n\t\t\tcpu.waiting = true;\n\t\t}\n\t\tSTATIC_END();\n", adress);
+					return;
+
+				case 0x33:
+					fprintf(out, "\t\tcpu.memory[cpu.I & (MEMORY_SIZE - 1)]       = cpu.V[0x%X] / 100;\n", x);
+					fprintf(out, "\t\tcpu.memory[(cpu.I + 1) & (MEMORY_SIZE - 1)] = (cpu.V[0x%X] / 10) %% 10;\n", x);
+					fprintf(out, "\t\tcpu.memory[(cpu.I + 2) & (MEMORY_SIZE - 1)] = cpu.V[0x%X] %% 10;\n", x);
+					fprintf(out, "\t\tcpu.invalidate(cpu.I);\n\t\tcpu.invalidate(cpu.I + 2);\n\t\tcpu.wrote(cpu.I, 3);\n");
+					fprintf(out, "\t\tSTATIC_LEAVE(0x%.3X);\n", next);
+					return;
+
+				case 0x55:
+					for(unsigned i = 0; i <= x; ++i){
+						fprintf(out, "\t\tcpu.memory[(cpu.I + %u) & (MEMORY_SIZE - 1)] = cpu.V[0x%X];\n\t\tcpu.invalidate(cpu.I + %u);\n", i, i, i);
+					}
+					fprintf(out, "\t\tcpu.wrote(cpu.I, %u);\n\t\tSTATIC_LEAVE(0x%.3X);\n", x + 1, next);
+					return;
+
+				default:
+					for(unsigned i = 0; i <= x; ++i){
+						fprintf(out, "\t\tcpu.V[0x%X] = cpu.memory[(cpu.I + %u) & (MEMORY_SIZE - 1)];\n", i, i);
+					}
+					break;
+			}
+			Emit_Go(out, block, next, "\t\t");
+			return;
+	}
+
+	fprintf(out, "\t\tif (%s){\n", condition);
+	Emit_Go(out, block, skip, "\t\t\t");
+	fprintf(out, "\t\t}\n");
+	Emit_Go(out, block, next, "\t\t");
+}
+
+/**
+ * @brief Cut the reached instructions into blocks and write a function for each one
+ * @details
+ * A block holds reached instructions following each other, of the same parity of adress,
+ * whatever jumps in between since it can be entered at any of them
+ * @return adress and length of every block, in order
+ */
+static std::vector<std::pair<u16, unsigned>> Emit_Blocks(FILE *out, Program &program, size_t index)
+{
+	std::vector<std::pair<u16, unsigned>> blocks;
+	static Block block;
+
+	for(unsigned start = START_ADRESS; start < program.end; ++start)
+	{
+		if (!program.reached[start] || program.compiled[start])
+			continue;
+
+		block.adress = start;
+		block.length = 0;
+		while (block.length < STATIC_BLOCK_LENGTH && start + 2 * block.length < program.end && program.reached[start + 2 * block.length])
+		{
+			program.compiled[start + 2 * block.length] = true;
+			++block.length;
+		}
+
+		// Labels are only written for the instructions gotos go to
+		memset(block.label, 0, sizeof(block.label));
+		for(unsigned k = 0; k < block.length; ++k)
+		{
+			const u16 adress = start + 2 * k;
+			unsigned targets[2];
+			const unsigned count = Successors(adress, program.opcode(adress), targets);
+
+			for(unsigned i = 0; i < count; ++i)
+			{
+				if (block.holds(targets[i])){
+					block.label[(targets[i] - start) / 2] = true;
+				}
+			}
+		}
+
+		fprintf(out, "\nstatic unsigned Static_%zu_%.3X(CPU &cpu, unsigned at, unsigned count)\n{\n\tunsigned left = count;\n\n\tswitch (at)\n\t{\n", index, start);
+		for(unsigned k = 0; k < block.length; ++k)
+		{
+			const u16 adress = start + 2 * k;
+			const u16 opcode = program.opcode(adress);
+			char text[DISASSEMBLY_SIZE];
+			char label[16] = "";
+
+			if (block.label[k]){
+				snprintf(label, sizeof(label), " a_%.3X:", adress);
+			}
+			Disassemble(opcode, text);
+			fprintf(out, "\tcase %u:%s // %.3X  %.4X  %s\n", k, label, adress, opcode, text);
+			Emit_Instruction(out, block, adress, opcode);
+		}
+		fprintf(out, "\t}\n\treturn 0;\n}\n");
+
+		blocks.push_back({ (u16)start, block.length });
+	}
+	return blocks;
+}
+
+/**
+ * @brief Write a file name for a C++ string literal or comment
+ * @details Bytes other than letters, digits, spaces, dots, dashes and underscores become octal escapes
+ */
+static void Write_Name(FILE *out, const std::string &name)
+{
+	for(unsigned char c : name)
+	{
+		if (isalnum(c) || c == ' ' || c == '.' || c == '-' || c == '_')
+			fputc(c, out);
+		else
+			fprintf(out, "\\%.3o", c);
+	}
+}
+
+/**
+ * @brief Print command usage
+ */
+static int Usage(void)
+{
+	printf("Usage: recompile <roms directory>... <output header>\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		return Usage();
+
+	const char *header = argv[argc - 1];
+
+	// Roms sorted by name in each directory so the header only changes with the roms
+	std::vector<std::filesystem::path> paths;
+	std::string directories;
+
+	for(int d = 1; d < argc - 1; ++d)
+	{
+		std::vector<std::filesystem::path> found;
+		std::error_code error;
+
+		for(const auto &entry : std::filesystem::directory_iterator(argv[d], error))
+		{
+			if (entry.is_regular_file()){
+				found.push_back(entry.path());
+			}
+		}
+		if (error)
+		{
+			fprintf(stderr, "Failed to read %s\n", argv[d]);
+			return 2;
+		}
+		std::sort(found.begin(), found.end());
+		paths.insert(paths.end(), found.begin(), found.end());
+
+		directories += (d > 1 ? " and " : "") + std::string(argv[d]);
+	}
+
+	FILE *out = fopen(header, "w");
+	if (!out)
+	{
+		fprintf(stderr, "Failed to write %s\n", header);
+		return 2;
+	}
+
+	fprintf(out, "/*\n * Generated by tools/Recompile.cpp from %s, do not edit\n */\n", directories.c_str());
+
+	std::vector<std::string> names;
+	std::vector<u32>         images;
+	std::vector<size_t>      sizes;
+	std::vector<unsigned>    counts;
+	unsigned long            total = 0;
+
+	for(const auto &path : paths)
+	{
+		std::ifstream file(path, std::ios::binary);
+		static Program program;
+
+		program.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		if (program.data.empty() || program.data.size() > ROM_MAX_SIZE)
+		{
+			fprintf(stderr, "Skipping %s, it is empty or does not fit in memory\n", path.string().c_str());
+			continue;
+		}
+		program.end = START_ADRESS + program.data.size();
+		memset(program.reached, 0, sizeof(program.reached));
+		memset(program.compiled, 0, sizeof(program.compiled));
+
+		// Same image as CHIP_8::load gives, the fontset then the rom
+		static CPU cpu;
+		memcpy(cpu.memory + START_ADRESS, program.data.data(), program.data.size());
+		memset(cpu.memory + START_ADRESS + program.data.size(), 0, ROM_MAX_SIZE - program.data.size());
+
+		const size_t index = names.size();
+		fprintf(out, "\n/*\n * ");
+		Write_Name(out, path.filename().string());
+		fprintf(out, "\n */\n");
+
+		fprintf(out, "\nstatic constexpr const u8 static_rom_%zu[] =\n{", index);
+		for(size_t i = 0; i < program.data.size(); ++i){
+			fprintf(out, "%s0x%.2X,", i % 16 ? " " : "\n\t", program.data[i]);
+		}
+		fprintf(out, "\n};\n");
+
+		Explore(program);
+		const std::vector<std::pair<u16, unsigned>> blocks = Emit_Blocks(out, program, index);
+
+		// The last entry is never read, the table is never empty
+		fprintf(out, "\nstatic constexpr const Static_Block static_blocks_%zu[] =\n{\n", index);
+		for(const auto &block : blocks){
+			fprintf(out, "\t{ 0x%.3X, %u, Static_%zu_%.3X },\n", block.first, block.second, index, block.first);
+		}
+		fprintf(out, "\t{ 0, 0, nullptr }\n};\n");
+
+		names.push_back(path.filename().string());
+		images.push_back((u32)Hash(cpu.memory, MEMORY_SIZE));
+		sizes.push_back(program.data.size());
+		counts.push_back(blocks.size());
+		total += blocks.size();
+	}
+
+	// The last entry marks the end, the table is never empty
+	fprintf(out, "\nstatic constexpr const Static_Program static_programs[] =\n{\n");
+	for(size_t i = 0; i < names.size(); ++i)
+	{
+		fprintf(out, "\t{ 0x%.8X, \"", images[i]);
+		Write_Name(out, names[i]);
+		fprintf(out, "\", static_rom_%zu, %zu, static_blocks_%zu, %u },\n", i, sizes[i], i, counts[i]);
+	}
+	fprintf(out, "\t{ 0, nullptr, nullptr, 0, nullptr, 0 }\n};\n");
+
+	if (fclose(out) != 0)
+	{
+		fprintf(stderr, "Failed to write %s\n", header);
+		return 2;
+	}
+	printf("Recompiled %zu roms into %lu blocks in %s\n", names.size(), total, header);
+	return 0;
+}
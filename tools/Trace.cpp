@@ -0,0 +1,512 @@
+/**
+ * @file  Trace.cpp
+ * @brief Reader of the traces written by chip8 --trace
+ * @details
+ * Prints the state of the machine before a cycle then the instructions executed from it, with
+ * what each one changed. Seeking only decompresses the block holding the cycle, found with the
+ * index at the end of the trace, or by going over the blocks when the trace was not completed.
+ * The format is described in src/CHIP-8/Trace.hpp
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "../src/CHIP-8/Trace.hpp"
+#include "../src/CHIP-8/Compress.hpp"
+#include "../src/CHIP-8/Delta.hpp"
+#include "../src/CHIP-8/Disassembler.hpp"
+
+/*
+ * Records printed when no count is given
+ */
+#define DEFAULT_COUNT 32
+
+/*
+ * Sizes of the parts of a trace, see Trace.hpp
+ */
+#define HEADER_SIZE       (12 + MEMORY_SIZE)
+#define BLOCK_HEADER_SIZE 28
+#define FOOTER_SIZE       16
+
+/*
+ * Block of the trace, its records are only read when it is loaded
+ */
+struct Block_Entry
+{
+	u64 first_cycle;
+	u64 cycles;
+	u64 offset;       /* Of the compressed records, after the header of the block */
+	u32 raw_size;
+	u32 packed_size;
+};
+
+/*
+ * Instruction executed, or cycles spent waiting on Fx0A
+ */
+struct Trace_Record
+{
+	u64           cycle;
+	unsigned long cycles;         /* 1 for an instruction */
+	u8            flags;
+	u16           pc;
+	u16           opcode;
+	u16           changed;        /* Mask of the V written */
+	u16           memory_adress;
+	u8            memory_length;
+};
+
+struct Trace_Reader
+{
+	std::ifstream file;
+	u32           image_id;
+	u8            image[MEMORY_SIZE];
+	std::vector<Block_Entry> blocks;
+
+	/*
+	 * Block being read, records are read from position
+	 */
+	size_t          current;
+	std::vector<u8> raw;
+	size_t          position;
+
+	/*
+	 * State before the next record
+	 */
+	u64         cycle;
+	Trace_State state;
+	u8          memory[MEMORY_SIZE];
+
+	bool open(const char *file_path);
+	bool load(size_t index);
+	bool seek(u64 target);
+	bool next(Trace_Record &record);
+
+	/**
+	 * @brief Cycles in the trace
+	 */
+	u64 cycles(void) const {
+		return blocks.empty() ? 0 : blocks.back().first_cycle + blocks.back().cycles;
+	}
+};
+
+/**
+ * @brief Read a 64 bits number
+ */
+static u64 Read_Qword(Byte_Reader &in)
+{
+	u64 low = in.dword();
+	return low | (u64)in.dword() << 32;
+}
+
+/**
+ * @brief Read bytes at an offset of the file
+ * @return false when the file is shorter
+ */
+static bool Read_At(std::ifstream &file, u64 offset, u8 *data, unsigned long size)
+{
+	file.clear();
+	file.seekg((std::streamoff)offset);
+	file.read((char*)data, size);
+	return (unsigned long)file.gcount() == size;
+}
+
+/**
+ * @brief Read the header of the block at offset
+ * @return false when there is no complete block there
+ */
+static bool Read_Block(std::ifstream &file, u64 offset, u64 size, Block_Entry &block)
+{
+	u8 header[BLOCK_HEADER_SIZE];
+
+	if (size < offset + BLOCK_HEADER_SIZE || !Read_At(file, offset, header, sizeof(header)))
+		return false;
+
+	Byte_Reader in = { header, header + sizeof(header), true };
+	if (in.dword() != 0x42543843)    // "C8TB"
+		return false;
+	block.first_cycle = Read_Qword(in);
+	block.cycles      = Read_Qword(in);
+	block.raw_size    = in.dword();
+	block.packed_size = in.dword();
+	block.offset      = offset + BLOCK_HEADER_SIZE;
+
+	return block.raw_size <= TRACE_BLOCK_SIZE && block.offset + block.packed_size <= size;
+}
+
+/**
+ * @brief Read the header and the list of blocks of a trace
+ * @details Without index, the trace was not closed, its blocks are read up to the first incomplete one
+ * @return false when the file is not a trace
+ */
+bool Trace_Reader::open(const char *file_path)
+{
+	file.open(file_path, std::ios::binary);
+	if (!file)
+	{
+		fprintf(stderr, "Failed to read %s\n", file_path);
+		return false;
+	}
+
+	file.seekg(0, std::ios::end);
+	const u64 size = (u64)file.tellg();
+
+	u8 header[12];
+	if (!Read_At(file, 0, header, sizeof(header)) || !Read_At(file, sizeof(header), image, MEMORY_SIZE))
+	{
+		fprintf(stderr, "%s is not a trace\n", file_path);
+		return false;
+	}
+
+	Byte_Reader in = { header, header + sizeof(header), true };
+	const u32 magic   = in.dword();
+	const u32 version = in.dword();
+	image_id = in.dword();
+
+	if (magic != 0x52543843 || version != TRACE_VERSION)    // "C8TR"
+	{
+		fprintf(stderr, "%s is not a trace of version %d\n", file_path, TRACE_VERSION);
+		return false;
+	}
+
+	// Blocks listed by the index
+	u8 footer[FOOTER_SIZE];
+	bool indexed = false;
+
+	if (size >= HEADER_SIZE + FOOTER_SIZE && Read_At(file, size - FOOTER_SIZE, footer, sizeof(footer)))
+	{
+		Byte_Reader tail = { footer, footer + sizeof(footer), true };
+		const u32 count        = tail.dword();
+		const u64 index_offset = Read_Qword(tail);
+		const u32 end_magic    = tail.dword();
+
+		if (end_magic == 0x45543843 && index_offset >= HEADER_SIZE && index_offset + (u64)count * 16 + FOOTER_SIZE == size)    // "C8TE"
+		{
+			std::vector<u8> index(count * 16ul);
+			indexed = Read_At(file, index_offset, index.data(), index.size());
+
+			Byte_Reader entries = { index.data(), index.data() + index.size(), true };
+			for(u32 i = 0; indexed && i < count; ++i)
+			{
+				Block_Entry block;
+				const u64 first_cycle = Read_Qword(entries);
+				const u64 offset      = Read_Qword(entries);
+
+				indexed = Read_Block(file, offset, index_offset, block) && block.first_cycle == first_cycle;
+				blocks.push_back(block);
+			}
+		}
+	}
+
+	// Blocks one after the other
+	if (!indexed)
+	{
+		blocks.clear();
+
+		Block_Entry block;
+		for(u64 offset = HEADER_SIZE; Read_Block(file, offset, size, block); offset = block.offset + block.packed_size){
+			blocks.push_back(block);
+		}
+		fprintf(stderr, "%s has no index, it was not completed\n", file_path);
+	}
+
+	current = blocks.size();
+	return true;
+}
+
+/**
+ * @brief Decompress a block and read its keyframe
+ * @return false when the block is damaged
+ */
+bool Trace_Reader::load(size_t index)
+{
+	const Block_Entry &block = blocks[index];
+	std::vector<u8> packed(block.packed_size);
+
+	raw.resize(block.raw_size);
+	current = blocks.size();
+
+	if (!Read_At(file, block.offset, packed.data(), packed.size()) || !Decompress(packed.data(), packed.size(), raw.data(), raw.size()))
+		return false;
+
+	Byte_Reader in = { raw.data(), raw.data() + raw.size(), true };
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		state.V[i] = in.byte();
+	}
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		state.stack[i] = in.word();
+	}
+	state.I           = in.word();
+	state.pc          = in.word();
+	state.sp          = in.byte();
+	state.delay_timer = in.byte();
+	state.sound_timer = in.byte();
+
+	const Byte_Reader delta = in;
+	if (!in.ok || !Check_Delta(in, MEMORY_SIZE))
+		return false;
+
+	memcpy(memory, image, MEMORY_SIZE);
+	Apply_Delta(delta, memory);
+
+	current  = index;
+	position = in.at - raw.data();
+	cycle    = block.first_cycle;
+	return true;
+}
+
+/**
+ * @brief Read the next record and apply it to the state
+ * @return false at the end of the trace or when it is damaged
+ */
+bool Trace_Reader::next(Trace_Record &record)
+{
+	if (current >= blocks.size())
+		return false;
+	if (position == raw.size())
+	{
+		if (current + 1 == blocks.size() || !load(current + 1))
+			return false;
+	}
+
+	Byte_Reader in = { raw.data() + position, raw.data() + raw.size(), true };
+
+	record.cycle   = cycle;
+	record.cycles  = 1;
+	record.flags   = in.byte();
+	record.pc      = record.flags & TRACE_PC ? in.word() : state.pc;
+	record.opcode  = 0;
+	record.changed = 0;
+	record.memory_length = 0;
+
+	if (record.flags & TRACE_WAIT)
+	{
+		if (record.flags & TRACE_TIMERS)
+		{
+			state.delay_timer = in.byte();
+			state.sound_timer = in.byte();
+		}
+		record.cycles = in.count();
+		state.pc      = record.pc;
+	}
+	else
+	{
+		if (record.flags & TRACE_OPCODE)
+			record.opcode = in.word();
+		else
+			record.opcode = memory[record.pc & (MEMORY_SIZE - 1)] << 8 | memory[(record.pc + 1) & (MEMORY_SIZE - 1)];
+
+		if (record.flags & TRACE_V)
+		{
+			record.changed = in.word();
+			for(unsigned i = 0; i < NUMBER_REGISTER; ++i)
+			{
+				if (record.changed & 1 << i){
+					state.V[i] = in.byte();
+				}
+			}
+		}
+		if (record.flags & TRACE_I){
+			state.I = in.word();
+		}
+		if (record.flags & TRACE_STACK)
+		{
+			const u8 sp = in.byte();
+			if (sp > state.sp && sp <= NUMBER_REGISTER){
+				state.stack[sp - 1] = in.word();
+			}
+			state.sp = sp;
+		}
+		if (record.flags & TRACE_TIMERS)
+		{
+			state.delay_timer = in.byte();
+			state.sound_timer = in.byte();
+		}
+		if (record.flags & TRACE_MEMORY)
+		{
+			record.memory_adress = in.word();
+			record.memory_length = in.byte();
+			if (record.memory_adress + record.memory_length > MEMORY_SIZE || (unsigned long)(in.end - in.at) < record.memory_length)
+				return false;
+			memcpy(memory + record.memory_adress, in.at, record.memory_length);
+			in.at += record.memory_length;
+		}
+		state.pc = record.pc + 2;
+	}
+
+	if (!in.ok || record.cycles == 0)
+		return false;
+
+	position = in.at - raw.data();
+	cycle   += record.cycles;
+	return true;
+}
+
+/**
+ * @brief Go to the state before a cycle
+ * @details A cycle inside a wait is reached at the start of the wait
+ * @return false when the trace is shorter or damaged
+ */
+bool Trace_Reader::seek(u64 target)
+{
+	if (target >= cycles())
+		return false;
+
+	// Last block starting before target
+	size_t index = std::upper_bound(blocks.begin(), blocks.end(), target,
+		[](u64 value, const Block_Entry &block){ return value < block.first_cycle; }) - blocks.begin() - 1;
+
+	if (!load(index))
+		return false;
+
+	while (cycle < target)
+	{
+		const size_t start = position;
+		Trace_Record record;
+
+		if (!next(record))
+			return false;
+		if (cycle > target)
+		{
+			// A wait changes nothing, the state before it is the one of target
+			position = start;
+			cycle    = record.cycle;
+			return true;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Print the registers before the next record
+ */
+static void Print_State(const Trace_Reader &reader, u16 pc)
+{
+	const Trace_State &state = reader.state;
+
+	printf("Cycle %llu of %llu\n", (unsigned long long)reader.cycle, (unsigned long long)reader.cycles());
+	printf("PC=0x%.3X I=0x%.3X SP=%u DT=%u ST=%u\n", pc, state.I, state.sp, state.delay_timer, state.sound_timer);
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i){
+		printf("V%X=%.2X%c", i, state.V[i], i % 8 == 7 ? '\n' : ' ');
+	}
+	printf("Stack:");
+	for(unsigned i = 0; i < state.sp && i < NUMBER_REGISTER; ++i){
+		printf(" 0x%.3X", state.stack[i]);
+	}
+	printf("\n\n");
+}
+
+/**
+ * @brief Print a record with the assembly of its instruction and what it changed
+ */
+static void Print_Record(const Trace_Reader &reader, const Trace_Record &record)
+{
+	const Trace_State &state = reader.state;
+
+	if (record.flags & TRACE_WAIT)
+	{
+		printf("%12llu  %.3X        waits %lu cycles for a key", (unsigned long long)record.cycle, record.pc, record.cycles);
+		if (record.flags & TRACE_TIMERS) printf(" DT=%u ST=%u", state.delay_timer, state.sound_timer);
+		printf("\n");
+		return;
+	}
+
+	char text[DISASSEMBLY_SIZE];
+	Disassemble(record.opcode, text);
+	printf("%12llu  %.3X  %.4X  %-18s", (unsigned long long)record.cycle, record.pc, record.opcode, text);
+
+	for(unsigned i = 0; i < NUMBER_REGISTER; ++i)
+	{
+		if (record.changed & 1 << i){
+			printf(" V%X=%.2X", i, state.V[i]);
+		}
+	}
+	if (record.flags & TRACE_I)      printf(" I=0x%.3X", state.I);
+	if (record.flags & TRACE_STACK)  printf(" SP=%u", state.sp);
+	if (record.flags & TRACE_TIMERS) printf(" DT=%u ST=%u", state.delay_timer, state.sound_timer);
+	if (record.flags & TRACE_MEMORY)
+	{
+		printf(" [0x%.3X]=", record.memory_adress);
+		for(unsigned i = 0; i < record.memory_length; ++i){
+			printf("%.2X", reader.memory[record.memory_adress + i]);
+		}
+	}
+	if (Classify_Opcode(record.opcode) == CLASS_INVALID) printf(" fault");
+	printf("\n");
+}
+
+/**
+ * @brief Print command usage
+ */
+static int Usage(void)
+{
+	printf("Usage: trace <trace file> [--from CYCLE] [--count N]\n");
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *file_path = nullptr;
+	unsigned long long from = 0;
+	unsigned long count     = DEFAULT_COUNT;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		char *end;
+
+		if (strcmp(argv[i], "--from") == 0 && i + 1 < argc)
+		{
+			from = strtoull(argv[++i], &end, 10);
+			if (*end != '\0')
+				return Usage();
+		}
+		else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+		{
+			count = strtoul(argv[++i], &end, 10);
+			if (*end != '\0')
+				return Usage();
+		}
+		else if (argv[i][0] != '-' && !file_path)
+			file_path = argv[i];
+		else
+			return Usage();
+	}
+	if (!file_path)
+		return Usage();
+
+	Trace_Reader reader;
+	if (!reader.open(file_path))
+		return 2;
+
+	u64 raw    = 0;
+	u64 packed = 0;
+	for(const Block_Entry &block : reader.blocks)
+	{
+		raw    += block.raw_size;
+		packed += block.packed_size;
+	}
+	printf("Rom %.8X, %llu cycles in %zu blocks, %llu bytes compressed to %llu\n", reader.image_id,
+		(unsigned long long)reader.cycles(), reader.blocks.size(), (unsigned long long)raw, (unsigned long long)packed);
+
+	if (!reader.seek(from))
+	{
+		fprintf(stderr, "Cycle %llu is not in the trace\n", from);
+		return 2;
+	}
+
+	// The pc of the next instruction is only known from its record, it is read then read again
+	Trace_Record record;
+	u16 pc = reader.state.pc;
+	if (reader.next(record))
+	{
+		pc = record.pc;
+		reader.seek(from);
+	}
+	Print_State(reader, pc);
+
+	for(unsigned long i = 0; i < count && reader.next(record); ++i){
+		Print_Record(reader, record);
+	}
+	return 0;
+}